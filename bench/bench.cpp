@@ -0,0 +1,223 @@
+#include "generator.h"
+#include "simulator.h"
+#include "timeline.h"
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+#include <unistd.h>
+using namespace std;
+
+// ways of running a trace that are timed
+enum {
+	MODE_TEXT, MODE_BINARY, MODE_FAST_FORWARD, MODE_TIMELINE, NUM_MODES
+};
+
+static const char *const mode_names[NUM_MODES] = {
+	"text", "binary", "fast-forward", "timeline"
+};
+
+static void usage()
+{
+	fprintf(stderr, "usage: pipe_bench [--min-exp n] [-m|--max-exp n] "
+		"[-r|--repeat n] [-s|--seed n]\n"
+		"                  [--mix spec] [-l|--latencies add,mul,div] "
+		"[-d|--dir directory]\n");
+	exit(EXIT_FAILURE);
+}
+
+// write count generated instructions as a text trace
+static void generate(const char *filename, const TraceMix &mix, 
+	unsigned seed, long count)
+{
+	TraceGenerator generator(mix, seed);
+	FILE *out = fopen(filename, "w");
+
+	if (!out) {
+		fprintf(stderr, "ERROR: could not open output file %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	for (long i = 0; i < count; ++i) {
+		const string &line = generator.next();
+		fwrite(line.data(), 1, line.size(), out);
+		fputc('\n', out);
+	}
+	if (fclose(out) != 0) {
+		fprintf(stderr, "ERROR: could not write output file %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+}
+
+// run one trace in one mode, returns the seconds taken or a negative value 
+// if the pipeline did not drain within a generous number of cycles
+static double measure(int mode, const string &text, const string &binary, 
+	SimulatorConfig config, long count, RunStats &stats)
+{
+	RegisterTable registers;
+	TraceReader reader;
+	BinaryTrace records;
+	CsvTimeline *timeline = NULL;
+	InstructionSource *source;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	bool stuck;
+
+	if (mode == MODE_TEXT) {
+		if (!reader.open(text.c_str())) {
+			throw SimulationError("could not open trace file " + text);
+		}
+		source = new StreamSource(reader, registers);
+	} else {
+		if (!records.open(binary.c_str(), registers)) {
+			throw SimulationError("could not open trace file " + binary);
+		}
+		source = new RecordSource(records.records(), records.size());
+	}
+	config.fast_forward = mode == MODE_FAST_FORWARD;
+	Simulator simulator(config, *source);
+	if (mode == MODE_TIMELINE) {
+		timeline = new CsvTimeline("/dev/null");
+		simulator.addSink(timeline);
+	}
+	try {
+		stuck = simulator.run(100 * count + 1000);
+	} catch (const SimulationError&) {
+		// fast-forward found the deadlock
+		stuck = true;
+	}
+	stats = simulator.stats();
+	delete timeline;
+	delete source;
+	if (stuck) {
+		return -1;
+	}
+	if (stats.instructions != count) {
+		// the pipeline ran empty before the end of the trace, the timing 
+		// would be of a different run
+		throw SimulationError("simulation ended after " + 
+			to_string(stats.instructions) + " of " + to_string(count) + 
+			" instructions");
+	}
+	return chrono::duration<double>(chrono::steady_clock::now() - 
+		start).count();
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{"min-exp", required_argument, NULL, 'e'},
+		{"max-exp", required_argument, NULL, 'm'},
+		{"repeat", required_argument, NULL, 'r'},
+		{"seed", required_argument, NULL, 's'},
+		{"mix", required_argument, NULL, 'x'},
+		{"latencies", required_argument, NULL, 'l'},
+		{"dir", required_argument, NULL, 'd'},
+		{NULL, 0, NULL, 0}
+	};
+	SimulatorConfig config;
+	TraceMix mix;
+	int min_exp = 3;
+	int max_exp = 6;
+	int repeat = 1;
+	unsigned seed = 1;
+	const char *dir = getenv("TMPDIR");
+	int opt;
+
+	config.fp_add_sub = 2;
+	config.fp_mul = 5;
+	config.fp_div = 10;
+	while ((opt = getopt_long(argc, argv, "m:r:s:l:d:", long_options, NULL))
+	!= -1) {
+		switch (opt) {
+		case 'e':
+			min_exp = atoi(optarg);
+			break;
+		case 'm':
+			// 10^8 instructions need about 1.3 GB of text trace
+			max_exp = atoi(optarg);
+			break;
+		case 'r':
+			// report the fastest of several runs
+			repeat = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'x':
+			if (!parseMix(mix, optarg)) {
+				fprintf(stderr, "ERROR: invalid mix %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'l':
+			if (sscanf(optarg, "%d,%d,%d", &config.fp_add_sub, &config.fp_mul, 
+				&config.fp_div) != 3) {
+				usage();
+			}
+			break;
+		case 'd':
+			dir = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || min_exp < 0 || max_exp < min_exp || max_exp > 9 || 
+		repeat < 1) {
+		usage();
+	}
+	string prefix = string(dir ? dir : "/tmp") + "/pipe_bench." + 
+		to_string(getpid());
+	string text = prefix + ".txt";
+	string binary = prefix + ".bin";
+
+	printf("%12s %-12s %10s %14s %10s %10s\n", "instructions", "mode", 
+		"seconds", "cycles", "Mcycles/s", "Minstr/s");
+	long count = 1;
+	for (int e = 0; e < min_exp; ++e) {
+		count *= 10;
+	}
+	for (int e = min_exp; e <= max_exp; ++e, count *= 10) {
+		generate(text.c_str(), mix, seed, count);
+		try {
+			RegisterTable registers;
+			TraceReader reader;
+			if (!reader.open(text.c_str())) {
+				throw SimulationError("could not open trace file " + text);
+			}
+			convertTrace(reader, registers, binary.c_str());
+			for (int mode = 0; mode < NUM_MODES; ++mode) {
+				RunStats stats;
+				double best = -1;
+				for (int r = 0; r < repeat; ++r) {
+					double seconds = measure(mode, text, binary, config, count, 
+						stats);
+					if (seconds >= 0 && (best < 0 || seconds < best)) {
+						best = seconds;
+					}
+				}
+				if (best < 0) {
+					// only generated traces with an fp-gap below the FP 
+					// latencies get here
+					printf("%12ld %-12s %10s %14ld  pipeline stalled for good\n", 
+						count, mode_names[mode], "-", stats.cycles);
+					continue;
+				}
+				printf("%12ld %-12s %10.4f %14ld %10.2f %10.2f\n", count, 
+					mode_names[mode], best, stats.cycles, 
+					stats.cycles / best / 1e6, stats.instructions / best / 1e6);
+				fflush(stdout);
+			}
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s\n", error.what());
+			unlink(text.c_str());
+			unlink(binary.c_str());
+			exit(EXIT_FAILURE);
+		}
+		unlink(text.c_str());
+		unlink(binary.c_str());
+	}
+	return 0;
+}
@@ -0,0 +1,150 @@
+#include "generator.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+static const char *const int_registers[] = {
+	"R1", "R2", "R3", "R4", "R5", "R6", "R7", "R8", "R9", "R10", "R11", 
+	"R12", "R13", "R14", "R15"
+};
+
+// FP results go to F0-F15 and FP operands come from F16-F31, which nothing 
+// writes, so FP instructions never wait for each other's results; only the 
+// MOV.S of the fp-use pattern reads a result
+static const int fp_results = 16;
+
+bool parseMix(TraceMix &mix, const char *spec)
+{
+	string item;
+	istringstream iss(spec);
+
+	while (getline(iss, item, ',')) {
+		size_t eq = item.find('=');
+		string name = item.substr(0, eq);
+		char *end;
+		long weight;
+
+		if (eq == string::npos) {
+			return false;
+		}
+		weight = strtol(item.c_str() + eq + 1, &end, 10);
+		if (*end != '\0' || end == item.c_str() + eq + 1 || weight < 0) {
+			return false;
+		}
+		if (name == "alu") {
+			mix.alu = weight;
+		} else if (name == "load-use") {
+			mix.load_use = weight;
+		} else if (name == "div") {
+			mix.div = weight;
+		} else if (name == "waw") {
+			mix.waw = weight;
+		} else if (name == "branch") {
+			mix.branch = weight;
+		} else if (name == "fp") {
+			mix.fp = weight;
+		} else if (name == "fp-use") {
+			mix.fp_use = weight;
+		} else if (name == "fp-gap") {
+			mix.fp_gap = weight;
+		} else {
+			return false;
+		}
+	}
+	return mix.alu + mix.load_use + mix.div + mix.waw + mix.branch + 
+		mix.fp + mix.fp_use > 0;
+}
+
+TraceGenerator::TraceGenerator(const TraceMix &trace_mix, unsigned seed)
+	: mix(trace_mix), random(seed)
+{
+	total_weight = mix.alu + mix.load_use + mix.div + mix.waw + mix.branch + 
+		mix.fp + mix.fp_use;
+	// a taken branch with nothing ahead of it empties the pipeline, which 
+	// ends the simulation, so the trace never starts with one
+	emit("DADD %s,%s,%s", intRegister(), intRegister(), intRegister());
+}
+
+const string &TraceGenerator::next()
+{
+	while (pending.empty()) {
+		pattern();
+	}
+	line.swap(pending.front());
+	pending.pop_front();
+	return line;
+}
+
+void TraceGenerator::emit(const char *format, ...)
+{
+	char text[64];
+	va_list args;
+
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+	pending.push_back(text);
+}
+
+const char *TraceGenerator::intRegister()
+{
+	return int_registers[random() % (sizeof(int_registers) / 
+		sizeof(int_registers[0]))];
+}
+
+// queue the instructions of one randomly chosen pattern
+void TraceGenerator::pattern()
+{
+	int pick = random() % total_weight;
+	int fp_result = random() % fp_results;
+	int fp_operand = fp_results + random() % (32 - fp_results - 1);
+	bool fp = false;
+	const char *reg;
+
+	if ((pick -= mix.alu) < 0) {
+		emit("DADD %s,%s,%s", intRegister(), intRegister(), intRegister());
+	} else if ((pick -= mix.load_use) < 0) {
+		reg = intRegister();
+		emit("LW %s,8(%s)", reg, intRegister());
+		emit("DSUB %s,%s,%s", intRegister(), reg, intRegister());
+	} else if ((pick -= mix.div) < 0) {
+		emit("DIV.S F%d,F%d,F%d", fp_result, fp_operand, fp_operand + 1);
+		emit("DIV.S F%d,F%d,F%d", (fp_result + 1) % fp_results, fp_operand, 
+			fp_operand + 1);
+		fp = true;
+	} else if ((pick -= mix.waw) < 0) {
+		emit("DIV.S F%d,F%d,F%d", fp_result, fp_operand, fp_operand + 1);
+		emit("ADD.S F%d,F%d,F%d", fp_result, fp_operand + 1, fp_operand);
+		fp = true;
+	} else if ((pick -= mix.branch) < 0) {
+		// the instruction after a taken branch is flushed, and one more keeps 
+		// the pipeline from running empty, which would end the simulation 
+		// early if another taken branch followed
+		emit("BNE %s,%s,loop:T", intRegister(), intRegister());
+		emit("DADD %s,%s,%s", intRegister(), intRegister(), intRegister());
+		emit("DADD %s,%s,%s", intRegister(), intRegister(), intRegister());
+	} else if ((pick -= mix.fp) < 0) {
+		emit("%s F%d,F%d,F%d", random() % 2 ? "ADD.S" : "MUL.S", fp_result, 
+			fp_operand, fp_operand + 1);
+		fp = true;
+	} else {
+		emit("%s F%d,F%d,F%d", random() % 2 ? "ADD.S" : "MUL.S", fp_result, 
+			fp_operand, fp_operand + 1);
+		for (int i = random() % 6; i > 0; --i) {
+			emit("DADD %s,%s,%s", intRegister(), intRegister(), 
+				intRegister());
+		}
+		emit("MOV.S F%d,F%d", (fp_result + 1) % fp_results, fp_result);
+		fp = true;
+	}
+	if (fp) {
+		for (int i = 0; i < mix.fp_gap; ++i) {
+			emit("DADD %s,%s,%s", intRegister(), intRegister(), 
+				intRegister());
+		}
+	}
+}
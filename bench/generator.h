@@ -0,0 +1,57 @@
+// synthetic traces in the text trace syntax, built from small patterns that 
+// each exercise one kind of hazard
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include <deque>
+#include <random>
+#include <string>
+
+// relative weights of the patterns
+struct TraceMix {
+	TraceMix() : alu(4), load_use(2), div(1), waw(1), branch(1), fp(1), 
+		fp_use(0), fp_gap(16) {}
+	// independent integer arithmetic
+	int alu;
+	// a load followed by an instruction using its result
+	int load_use;
+	// two DIV.S back to back, the second waits for the divider
+	int div;
+	// a DIV.S whose result is overwritten by a following ADD.S
+	int waw;
+	// a taken branch, which flushes the next instruction, and two integer 
+	// instructions
+	int branch;
+	// a single independent ADD.S or MUL.S
+	int fp;
+	// an ADD.S or MUL.S whose result a MOV.S reads up to five instructions 
+	// later, around the cycle it completes
+	int fp_use;
+	// integer instructions following every FP pattern; with two FP results 
+	// finishing in the same cycle one of them never writes back and the 
+	// pipeline stalls for good, so FP patterns are kept apart by more 
+	// instructions than the longest FP latency
+	int fp_gap;
+};
+
+// parse a mix such as "alu=4,div=1,fp-gap=20" over the default weights, 
+// false if it is not valid
+bool parseMix(TraceMix &mix, const char *spec);
+
+class TraceGenerator {
+public:
+	TraceGenerator(const TraceMix &mix, unsigned seed);
+	// next instruction, without a line break
+	const std::string &next();
+private:
+	void pattern();
+	void emit(const char *format, ...);
+	const char *intRegister();
+	TraceMix mix;
+	int total_weight;
+	std::mt19937 random;
+	std::deque<std::string> pending;
+	std::string line;
+};
+
+#endif
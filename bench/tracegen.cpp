@@ -0,0 +1,69 @@
+#include "generator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+using namespace std;
+
+static void usage()
+{
+	fprintf(stderr, "usage: tracegen [-n|--instructions n] [-s|--seed n] "
+		"[-m|--mix spec] [output-file]\n"
+		"       spec: alu=4,load-use=2,div=1,waw=1,branch=1,fp=1,fp-use=0,"
+		"fp-gap=16\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{"instructions", required_argument, NULL, 'n'},
+		{"seed", required_argument, NULL, 's'},
+		{"mix", required_argument, NULL, 'm'},
+		{NULL, 0, NULL, 0}
+	};
+	TraceMix mix;
+	long count = 1000;
+	unsigned seed = 1;
+	FILE *out = stdout;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "n:s:m:", long_options, NULL))
+	!= -1) {
+		switch (opt) {
+		case 'n':
+			count = atol(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			if (!parseMix(mix, optarg)) {
+				fprintf(stderr, "ERROR: invalid mix %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind < argc - 1 || count < 0) {
+		usage();
+	} else if (optind == argc - 1 && !(out = fopen(argv[optind], "w"))) {
+		fprintf(stderr, "ERROR: could not open output file %s\n", 
+			argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+
+	TraceGenerator generator(mix, seed);
+	for (long i = 0; i < count; ++i) {
+		const string &line = generator.next();
+		fwrite(line.data(), 1, line.size(), out);
+		fputc('\n', out);
+	}
+	if (fclose(out) != 0) {
+		fprintf(stderr, "ERROR: could not write output file\n");
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include "checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+using namespace std;
+
+static const char checkpoint_magic[8] = {
+	'P', 'I', 'P', 'E', 'C', 'K', '0', '2'
+};
+
+CheckpointWriter::CheckpointWriter() 
+	: data(checkpoint_magic, checkpoint_magic + sizeof(checkpoint_magic))
+{
+}
+
+void CheckpointWriter::put(const void *bytes, size_t size)
+{
+	data.insert(data.end(), (const char *)bytes, (const char *)bytes + size);
+}
+
+void CheckpointWriter::save(const char *filename) const
+{
+	FILE *file = fopen(filename, "wb");
+	bool written;
+
+	if (!file) {
+		throw SimulationError(string("could not open checkpoint file ") + 
+			filename);
+	}
+	written = fwrite(data.data(), 1, data.size(), file) == data.size();
+	if (fclose(file) != 0 || !written) {
+		throw SimulationError(string("could not write checkpoint file ") + 
+			filename);
+	}
+}
+
+CheckpointReader::CheckpointReader(const char *filename) : pos(0)
+{
+	FILE *file = fopen(filename, "rb");
+	char chunk[1 << 16];
+	size_t n;
+
+	if (!file) {
+		throw SimulationError(string("could not open checkpoint file ") + 
+			filename);
+	}
+	while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		data.insert(data.end(), chunk, chunk + n);
+	}
+	fclose(file);
+	if (data.size() < sizeof(checkpoint_magic) || 
+	memcmp(data.data(), checkpoint_magic, sizeof(checkpoint_magic) - 2) != 0) {
+		throw SimulationError(string(filename) + " is not a checkpoint");
+	}
+	if (memcmp(data.data(), checkpoint_magic, sizeof(checkpoint_magic)) != 0) {
+		// the last two characters are the version of the fields
+		throw SimulationError(string(filename) + 
+			" is a checkpoint of another version");
+	}
+	pos = sizeof(checkpoint_magic);
+}
+
+int64_t CheckpointReader::getInt()
+{
+	int64_t value;
+
+	if (data.size() - pos < sizeof(value)) {
+		damaged();
+	}
+	memcpy(&value, data.data() + pos, sizeof(value));
+	pos += sizeof(value);
+	return value;
+}
+
+int64_t CheckpointReader::getInt(int64_t low, int64_t high)
+{
+	int64_t value = getInt();
+
+	if (value < low || value > high) {
+		damaged();
+	}
+	return value;
+}
+
+void CheckpointReader::finish() const
+{
+	if (pos != data.size()) {
+		damaged();
+	}
+}
+
+void CheckpointReader::damaged() const
+{
+	throw SimulationError("damaged checkpoint");
+}
@@ -0,0 +1,45 @@
+// checkpoint files: the complete state of a simulation, so that it can be 
+// resumed later, elsewhere, or split into segments run by different workers
+//
+// a checkpoint is an 8 byte magic number followed by fixed-size fields in 
+// host byte order, like binary traces; it does not hold the trace itself, 
+// only how many instructions of it were fetched and a hash of them; the 
+// number in the magic goes up whenever the fields change
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "isa.h"
+
+#include <cstdint>
+#include <vector>
+
+// collects the fields of a checkpoint and writes them out in one go
+class CheckpointWriter {
+public:
+	CheckpointWriter();
+	void putInt(int64_t value) { put(&value, sizeof(value)); }
+	// write the checkpoint, throws if the file cannot be written
+	void save(const char *filename) const;
+private:
+	void put(const void *data, size_t size);
+	std::vector<char> data;
+};
+
+// reads back what a CheckpointWriter wrote; anything missing or out of 
+// range is thrown as a damaged checkpoint
+class CheckpointReader {
+public:
+	// read a whole checkpoint, throws if it cannot be read or is not one
+	CheckpointReader(const char *filename);
+	int64_t getInt();
+	// a field that has to lie within [low, high]
+	int64_t getInt(int64_t low, int64_t high);
+	// throws unless every field has been read
+	void finish() const;
+	[[noreturn]] void damaged() const;
+private:
+	std::vector<char> data;
+	size_t pos;
+};
+
+#endif
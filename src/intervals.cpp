@@ -0,0 +1,74 @@
+#include "intervals.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+IntervalWriter::IntervalWriter(const char *filename, long window, 
+	bool instructions) : out(new BufferedWriter(filename)), length(window), 
+	by_instructions(instructions)
+{
+	static const char header[] = "cycle,cycles,retired,CPI,IPC,load-delay,"
+		"structural,data,WAW,flushes,FADD,FMUL,FDIV\n";
+	out->write(header, sizeof(header) - 1);
+}
+
+IntervalWriter::~IntervalWriter()
+{
+	delete out;
+}
+
+void IntervalWriter::run(Simulator &simulator, long limit)
+{
+	RunStats from = simulator.stats();
+
+	while (!simulator.done() && simulator.stats().cycles < limit) {
+		if (by_instructions) {
+			simulator.runRetired(length, limit - simulator.stats().cycles);
+		} else {
+			simulator.run(min(length, limit - simulator.stats().cycles));
+		}
+		write(from, simulator.stats());
+		from = simulator.stats();
+	}
+	out->flush();
+}
+
+void IntervalWriter::write(const RunStats &from, const RunStats &to)
+{
+	long cycles = to.cycles - from.cycles;
+	long retired = to.retired - from.retired;
+	char text[32];
+
+	out->putInt(to.cycles);
+	out->put(',');
+	out->putInt(cycles);
+	out->put(',');
+	out->putInt(retired);
+	out->put(',');
+	if (retired > 0) {
+		out->write(text, snprintf(text, sizeof(text), "%.4f", 
+			(double)cycles / retired));
+	}
+	out->put(',');
+	out->write(text, snprintf(text, sizeof(text), "%.4f", 
+		cycles > 0 ? (double)retired / cycles : 0.0));
+	out->put(',');
+	out->putInt(to.load_delay_hazard_cycles - from.load_delay_hazard_cycles);
+	out->put(',');
+	out->putInt(to.structural_hazard_cycles - from.structural_hazard_cycles);
+	out->put(',');
+	out->putInt(to.data_hazard_cycles - from.data_hazard_cycles);
+	out->put(',');
+	out->putInt(to.waw_squashes - from.waw_squashes);
+	out->put(',');
+	out->putInt(to.branch_flushes - from.branch_flushes);
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		out->put(',');
+		out->write(text, snprintf(text, sizeof(text), "%.3f", cycles > 0 ? 
+			(double)(to.fp_busy_cycles[unit] - from.fp_busy_cycles[unit]) / 
+			cycles : 0.0));
+	}
+	out->put('\n');
+}
@@ -0,0 +1,36 @@
+// statistics over consecutive windows of a run, so that the phases of a 
+// long trace can be told apart
+#ifndef INTERVALS_H
+#define INTERVALS_H
+
+#include "simulator.h"
+#include "timeline.h"
+
+// writes one CSV line per window of cycles or of retired instructions:
+//
+//	cycle,cycles,retired,CPI,IPC,load-delay,structural,data,WAW,flushes,
+//	FADD,FMUL,FDIV
+//
+// where cycle is the last cycle of the window, CPI and IPC are over retired 
+// instructions (CPI is empty if none retired) and FADD, FMUL and FDIV are 
+// the fraction of the window's cycles in which the unit executed
+//
+// the counters come from RunStats, which the simulator keeps anyway, and the 
+// run is driven in whole windows, so fast-forward and loop extrapolation 
+// still apply and the cost over a run without windows is the lines written
+class IntervalWriter {
+public:
+	// windows of length cycles, or of at least length retired instructions
+	IntervalWriter(const char *filename, long length, bool by_instructions);
+	~IntervalWriter();
+	// simulate to the end of the run or up to cycle limit, one line per 
+	// window, the last of which may be shorter
+	void run(Simulator &simulator, long limit);
+private:
+	void write(const RunStats &from, const RunStats &to);
+	BufferedWriter *out;
+	long length;
+	bool by_instructions;
+};
+
+#endif
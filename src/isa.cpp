@@ -0,0 +1,202 @@
+#include "isa.h"
+
+#include <fstream>
+#include <sstream>
+using namespace std;
+
+OpcodeInfo opcodes[MAX_OPCODES] = {
+	{"LW", FORMAT_LOAD, STAGE_NONE, WRITEBACK_WB, 0},
+	{"SW", FORMAT_STORE, STAGE_NONE, WRITEBACK_NONE, 0},
+	{"L.S", FORMAT_LOAD, STAGE_NONE, WRITEBACK_FWB, 0},
+	{"S.S", FORMAT_STORE, STAGE_NONE, WRITEBACK_NONE, 0},
+	{"BEQ", FORMAT_BRANCH, STAGE_NONE, WRITEBACK_NONE, 0},
+	{"BNE", FORMAT_BRANCH, STAGE_NONE, WRITEBACK_NONE, 0},
+	{"MFC1", FORMAT_MOVE, STAGE_NONE, WRITEBACK_WB, 0},
+	{"MTC1", FORMAT_MOVE_TO, STAGE_NONE, WRITEBACK_FWB, 0},
+	{"MOV.S", FORMAT_MOVE, STAGE_NONE, WRITEBACK_FWB, 0},
+	{"CVT.S.W", FORMAT_MOVE, STAGE_NONE, WRITEBACK_FWB, 0},
+	{"CVT.W.S", FORMAT_MOVE, STAGE_NONE, WRITEBACK_FWB, 0},
+	{"DADD", FORMAT_ARITH, STAGE_NONE, WRITEBACK_WB, 0},
+	{"DSUB", FORMAT_ARITH, STAGE_NONE, WRITEBACK_WB, 0},
+	{"AND", FORMAT_ARITH, STAGE_NONE, WRITEBACK_WB, 0},
+	{"OR", FORMAT_ARITH, STAGE_NONE, WRITEBACK_WB, 0},
+	{"XOR", FORMAT_ARITH, STAGE_NONE, WRITEBACK_WB, 0},
+	{"ADD.S", FORMAT_ARITH, STAGE_FADD, WRITEBACK_FWB, 0},
+	{"SUB.S", FORMAT_ARITH, STAGE_FADD, WRITEBACK_FWB, 0},
+	{"MUL.S", FORMAT_ARITH, STAGE_FMUL, WRITEBACK_FWB, 0},
+	{"DIV.S", FORMAT_ARITH, STAGE_FDIV, WRITEBACK_FWB, 0}
+};
+
+int opcode_count = NUM_OPCODES;
+
+// names used by opcode files, the EX stage stands for no FP unit
+static const char *const format_names[NUM_FORMATS] = {
+	"load", "store", "branch", "move", "move-to", "arith"
+};
+static const char *const writeback_names[NUM_WRITEBACKS] = {
+	"none", "wb", "fwb"
+};
+static const char *const unit_names[NUM_STAGES] = {
+	"ex", NULL, NULL, NULL, NULL, "fadd", "fmul", "fdiv"
+};
+
+int findOpcode(string_view mnemonic)
+{
+	for (int op = 0; op < opcode_count; ++op) {
+		if (mnemonic == opcodes[op].name) {
+			return op;
+		}
+	}
+	return -1;
+}
+
+// index of name in names, -1 if it is not there
+static int lookup(const string &name, const char *const *names, int count)
+{
+	for (int i = 0; i < count; ++i) {
+		if (names[i] && name == names[i]) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+// each line is "mnemonic format unit writeback [latency]", such as 
+// "MADD.S arith fmul fwb 7" or "NOR arith ex wb", with "-" or no latency 
+// for the one configured for the unit, which ex does not have; a mnemonic 
+// already in the table is redefined, any other is added
+void loadOpcodes(const char *filename)
+{
+	ifstream in(filename);
+	string line;
+	int line_number = 0;
+
+	if (!in) {
+		throw SimulationError(string("could not open opcode file ") + 
+			filename);
+	}
+	while (getline(in, line)) {
+		istringstream fields(line.substr(0, line.find('#')));
+		OpcodeInfo info;
+		string format, unit, writeback, rest;
+		int latency = 0;
+		int op, value;
+		string where = string(filename) + ", line " + 
+			to_string(++line_number) + ": ";
+
+		if (!(fields >> info.name)) {
+			continue;
+		}
+		if (!(fields >> format >> unit >> writeback)) {
+			throw SimulationError(where + 
+				"expected mnemonic, format, unit and writeback");
+		}
+		if ((fields >> rest) && rest != "-") {
+			istringstream number(rest);
+			if (!(number >> latency) || !number.eof() || latency < 1 || 
+				latency > 255) {
+				throw SimulationError(where + "invalid latency " + 
+					rest);
+			}
+		}
+		if (fields >> rest) {
+			throw SimulationError(where + "unexpected " + rest);
+		}
+		if ((value = lookup(format, format_names, NUM_FORMATS)) < 0) {
+			throw SimulationError(where + "unknown format " + format);
+		}
+		info.format = value;
+		if ((value = lookup(unit, unit_names, NUM_STAGES)) < 0) {
+			throw SimulationError(where + "unknown unit " + unit);
+		}
+		info.unit = value;
+		if ((value = lookup(writeback, writeback_names, NUM_WRITEBACKS)) < 0) {
+			throw SimulationError(where + "unknown writeback " + 
+				writeback);
+		}
+		info.writeback = value;
+		info.latency = latency;
+		// the pipeline only has these paths: stores and branches write 
+		// nothing back, and FP units take register operands and write back 
+		// through FWB
+		if ((info.format == FORMAT_STORE || info.format == FORMAT_BRANCH) != 
+			(info.writeback == WRITEBACK_NONE)) {
+			throw SimulationError(where + "only stores and branches " 
+				"write nothing back");
+		}
+		if (info.unit != STAGE_NONE && (info.format == FORMAT_LOAD || 
+			info.writeback != WRITEBACK_FWB)) {
+			throw SimulationError(where + "FP units need register " 
+				"operands and write back through fwb");
+		}
+		if (info.unit == STAGE_NONE && latency) {
+			// EX always takes a single cycle
+			throw SimulationError(where + "only the fadd, fmul and fdiv " 
+				"units take a latency");
+		}
+		if ((op = findOpcode(info.name)) < 0) {
+			if (opcode_count == MAX_OPCODES) {
+				throw SimulationError(where + "too many opcodes");
+			}
+			op = opcode_count++;
+		}
+		opcodes[op] = info;
+	}
+}
+
+uint16_t RegisterTable::intern(string_view name)
+{
+	if (name.empty()) {
+		return NO_REG;
+	}
+	unordered_map<string_view, uint16_t>::iterator it = indices.find(name);
+	if (it != indices.end()) {
+		return it->second;
+	}
+	if (names.size() == NO_REG) {
+		throw SimulationError("too many distinct registers in the trace");
+	}
+	names.push_back(string(name));
+	indices[names.back()] = names.size() - 1;
+	return names.size() - 1;
+}
+
+string formatInstruction(const DecodedInstruction &decoded, 
+	const RegisterTable &registers)
+{
+	auto name = [&](uint16_t reg) {
+		return reg == NO_REG ? string() : registers.name(reg);
+	};
+	const OpcodeInfo &info = opcodes[decoded.opcode];
+	string text = info.name;
+
+	text += ' ';
+	switch (info.format) {
+	case FORMAT_LOAD:
+		text += name(decoded.destination_register) + ",(" + 
+			name(decoded.source_register1) + ")";
+		break;
+	case FORMAT_STORE:
+		text += name(decoded.source_register1) + ",(" + 
+			name(decoded.destination_register) + ")";
+		break;
+	case FORMAT_BRANCH:
+		text += name(decoded.source_register1) + "," + 
+			name(decoded.source_register2) + 
+			(decoded.flags & FLAG_TAKEN ? ",:T" : ",:N");
+		break;
+	case FORMAT_MOVE:
+		text += name(decoded.destination_register) + "," + 
+			name(decoded.source_register1);
+		break;
+	case FORMAT_MOVE_TO:
+		text += name(decoded.source_register1) + "," + 
+			name(decoded.destination_register);
+		break;
+	default:
+		text += name(decoded.destination_register) + "," + 
+			name(decoded.source_register1) + "," + 
+			name(decoded.source_register2);
+	}
+	return text;
+}
@@ -0,0 +1,146 @@
+// instruction set of the traces and their decoded form
+#ifndef ISA_H
+#define ISA_H
+
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// opcodes built into the decoder, more can be loaded with loadOpcodes
+enum Opcode {
+	OP_LW, OP_SW, OP_L_S, OP_S_S, OP_BEQ, OP_BNE, OP_MFC1, OP_MTC1, OP_MOV_S, 
+	OP_CVT_S_W, OP_CVT_W_S, OP_DADD, OP_DSUB, OP_AND, OP_OR, OP_XOR, OP_ADD_S, 
+	OP_SUB_S, OP_MUL_S, OP_DIV_S, NUM_OPCODES
+};
+
+// pipeline stages an instruction can occupy
+enum Stage {
+	STAGE_NONE, STAGE_IF, STAGE_ID, STAGE_EX, STAGE_MEM, STAGE_FADD, 
+	STAGE_FMUL, STAGE_FDIV, NUM_STAGES
+};
+
+// FP functional units, in stage order from STAGE_FADD
+const int NUM_FP_UNITS = STAGE_FDIV - STAGE_FADD + 1;
+
+// decoded instruction flags
+enum {
+	// destination register is in the floating point register file
+	FLAG_FP_DEST = 1,
+	// branch is taken
+	FLAG_TAKEN = 2
+};
+
+// register index of an operand that is not present
+const uint16_t NO_REG = 0xffff;
+
+// operand layouts of the trace syntax
+enum Format {
+	// rd,offset(rs)
+	FORMAT_LOAD,
+	// rs,offset(rd), the address register counts as the destination
+	FORMAT_STORE,
+	// rs,rt,label:T or rs,rt,label:N
+	FORMAT_BRANCH,
+	// rd,rs
+	FORMAT_MOVE,
+	// rs,rd, as MTC1 is written
+	FORMAT_MOVE_TO,
+	// rd,rs,rt
+	FORMAT_ARITH,
+	NUM_FORMATS
+};
+
+// where results are written back
+enum Writeback {
+	// stores complete in MEM and branches in ID
+	WRITEBACK_NONE,
+	// the WB stage after MEM
+	WRITEBACK_WB,
+	// the FWB stage, straight after MEM or once the FP unit has finished
+	WRITEBACK_FWB,
+	NUM_WRITEBACKS
+};
+
+// how an opcode is written in the trace and how the pipeline treats it; the 
+// decoder and the simulator look everything up here, so an opcode that fits 
+// an existing format and unit needs only a new entry
+struct OpcodeInfo {
+	// mnemonic as it appears in the trace
+	std::string name;
+	uint8_t format;
+	// stage of the FP functional unit that executes it, STAGE_NONE for 
+	// the EX stage
+	uint8_t unit;
+	uint8_t writeback;
+	// execution cycles, 0 for the latency configured for its unit
+	uint8_t latency;
+};
+
+// opcodes fit in the byte of a DecodedInstruction
+const int MAX_OPCODES = 256;
+
+// the built-in opcodes in the order of enum Opcode, followed by any added by 
+// loadOpcodes; binary traces and checkpoints store indices into this table, 
+// so they need the same table to be read back
+extern OpcodeInfo opcodes[MAX_OPCODES];
+extern int opcode_count;
+
+// index of the opcode with the mnemonic, -1 if there is none
+int findOpcode(std::string_view mnemonic);
+// change or add opcodes as described in a file, throws on errors
+void loadOpcodes(const char *filename);
+
+inline bool isLoad(int op) { return opcodes[op].format == FORMAT_LOAD; }
+inline bool isStore(int op) { return opcodes[op].format == FORMAT_STORE; }
+inline bool isBranch(int op) { return opcodes[op].format == FORMAT_BRANCH; }
+inline bool isFPArith(int op) { return opcodes[op].unit != STAGE_NONE; }
+// stage of the FP functional unit that executes op, STAGE_NONE if op does 
+// not use one
+inline int unitStage(int op) { return opcodes[op].unit; }
+// instructions that write back an FP register right after the MEM stage
+inline bool writesBackAfterMem(int op)
+{
+	return opcodes[op].writeback == WRITEBACK_FWB && 
+		opcodes[op].unit == STAGE_NONE;
+}
+
+// problem with a trace or a run, reported as "ERROR: <what>"
+class SimulationError : public std::runtime_error {
+public:
+	SimulationError(const std::string &what) : std::runtime_error(what) {}
+};
+
+// compact form of one trace line, registers are indices into the trace's
+// RegisterTable
+struct DecodedInstruction {
+	uint8_t opcode;
+	uint8_t flags;
+	uint16_t destination_register;
+	uint16_t source_register1;
+	uint16_t source_register2;
+};
+
+// binary traces store this struct as is
+static_assert(sizeof(DecodedInstruction) == 8, "binary trace record size");
+
+// maps register names to small indices, one table per trace
+class RegisterTable {
+public:
+	uint16_t intern(std::string_view name);
+	const std::string &name(uint16_t reg) const { return names[reg]; }
+	size_t size() const { return names.size(); }
+private:
+	// keys point into names, a deque never moves its elements
+	std::unordered_map<std::string_view, uint16_t> indices;
+	std::deque<std::string> names;
+};
+
+// an instruction in trace syntax, without the displacements and branch 
+// labels that decoding drops, such as "LW R1,(R2)" or "BNE R1,R2,:T"
+std::string formatInstruction(const DecodedInstruction&, 
+	const RegisterTable&);
+
+#endif
@@ -1,555 +1,807 @@
+#include "intervals.h"
+#include "profile.h"
+#include "sampler.h"
+#include "server.h"
+#include "simulator.h"
+#include "timeline.h"
+#include "trace.h"
+
+#include <climits>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <getopt.h>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unistd.h>
 #include <vector>
 using namespace std;
 
-class Instruction {
+// runs a fixed set of tasks on a group of threads; each thread starts on its
+// own contiguous share of the tasks and, once that is used up, steals tasks 
+// from the far end of the other threads' shares
+class WorkStealingPool {
 public:
-	Instruction(string t, string dest_reg, string source_reg1, 
-	string source_reg2, char branch_t, int cycles, int i)
-	{
-		type = t;
-		destination_register = dest_reg;
-		source_register1 = source_reg1;
-		source_register2 = source_reg2;
-		branch_taken = branch_t;
-		stage = "";
-		cycles_needed = cycles;
-		cycles_completed = 0;
-		id = i;
-		stalled = false;
-		result_squashed = false;
-	}
-	string type;
-	string destination_register;
-	string source_register1;
-	string source_register2;
-	// current pipeline stage
-	string stage;
-	// if branch instruction, either T (taken) or F (not taken)
-	char branch_taken;
-	// needed execution cycles
-	int cycles_needed;
-	// completed execution cycles
-	int cycles_completed;
-	// instruction number
-	int id;
-	// is/is not stalled due to hazard
-	bool stalled;
-	// result has/has not been squashed to WAW
-	bool result_squashed;
+	WorkStealingPool(int threads) : queues(threads) {}
+	// call task(0) ... task(tasks - 1), returns when all calls have returned
+	void run(size_t tasks, const function<void(size_t)> &task);
+private:
+	struct Queue {
+		mutex lock;
+		deque<size_t> tasks;
+	};
+	// next task for thread self, false once every queue is empty
+	bool take(size_t self, size_t &task);
+	vector<Queue> queues;
 };
 
-void getConfig(map<string, int>&, const char*);
-void getInstructions(vector<Instruction>&, map<string, int>&);
-void executeInstructions(vector<Instruction>&);
+void getConfig(SimulatorConfig&, const char*, bool);
+void printStatistics(const RunStats&, bool);
+void printEstimate(const SampleEstimate&, const SamplingConfig&);
+bool runBatch(const vector<string>&, const SimulatorConfig&, int);
+bool runSweep(const DecodedInstruction*, size_t, 
+	const vector<SimulatorConfig>&, int);
 
-int main(int argc, char **argv)
+// configurations of a sweep that have run the same cycles so far, and the 
+// simulator that ran them (none before the first cycle) with its source
+struct SweepBranch {
+	vector<size_t> members;
+	shared_ptr<RecordSource> source;
+	shared_ptr<Simulator> simulator;
+};
+
+// one latency range of a sweep
+struct SweepRange {
+	const char *name;
+	int SimulatorConfig::*latency;
+	int first;
+	int last;
+	int step;
+};
+
+// checkpoints to save during a run and where to resume it from
+struct CheckpointPlan {
+	CheckpointPlan() : file(NULL), by_instructions(false), restore(NULL), 
+		stop_at(-1) {}
+	// numbered .1, .2, ... when there are several points
+	const char *file;
+	// ascending cycles, or numbers of instructions fetched, to save at
+	vector<long> points;
+	bool by_instructions;
+	const char *restore;
+	// last cycle to simulate, -1 to simulate the whole trace
+	long stop_at;
+};
+
+// strip surrounding whitespace
+static string trim(const string &str)
 {
-	map<string, int> ex_cycles;
-	vector<Instruction> instructions;
-	getConfig(ex_cycles, "config.txt");
-	getInstructions(instructions, ex_cycles);
-	executeInstructions(instructions);
-	return 0;
+	size_t first = str.find_first_not_of(" \t\r");
+	if (first == string::npos) {
+		return "";
+	}
+	return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
 }
 
-void getConfig(map<string, int> &config, const char *filename)
+// long options without a short form
+enum {
+	OPT_TIMELINE_CSV = 256, OPT_TIMELINE_BIN, OPT_SWEEP, OPT_CONVERT, 
+	OPT_CHECKPOINT, OPT_CHECKPOINT_AT, OPT_CHECKPOINT_AFTER, OPT_RESTORE, 
+	OPT_STOP_AT, OPT_SAMPLE, OPT_HOTSPOTS, OPT_PROFILE, OPT_INTERVALS, 
+	OPT_INTERVAL_CYCLES, OPT_INTERVAL_INSTRUCTIONS, OPT_TIMELINE_JSON, 
+	OPT_OPCODES, OPT_SERVE
+};
+
+static void usage()
 {
-	// open configuration file
-	ifstream in(filename);
-	string str;
-	// check if file failed to open
-	if (!in) {
-		fprintf(stderr, "ERROR: could not open config file %s\n", filename);
+	fprintf(stderr, "usage: pipe [-s|--stream] [-f|--fast-forward] "
+		"[-l|--loops] [-q|--quiet]\n"
+		"            [--timeline-csv file] [--timeline-bin file] "
+		"[--timeline-json file]\n"
+		"            [trace-file]\n"
+		"            [--checkpoint file] [--checkpoint-at cycle,...] "
+		"[--checkpoint-after n,...]\n"
+		"            [--restore file] [--stop-at cycle]\n"
+		"            [--hotspots n] [--profile file] [--intervals file]\n"
+		"            [--interval-cycles n | --interval-instructions n]\n"
+		"       pipe -b|--batch list-file [-j|--jobs n] [-l|--loops]\n"
+		"       pipe --sweep name=first[:last[:step]],... [-j|--jobs n] "
+		"[-l|--loops]\n"
+		"            [trace-file]\n"
+		"       pipe --convert binary-file [trace-file]\n"
+		"       pipe --sample interval[,window[,warmup]] [trace-file]\n"
+		"       pipe --serve socket [-j|--jobs n] [-l|--loops]\n"
+		"each form also takes [--opcodes file]\n");
+	exit(EXIT_FAILURE);
+}
+
+// create the timeline writer for a --timeline option, exiting if its file 
+// cannot be created
+static EventSink *openTimeline(int option, const char *filename)
+{
+	try {
+		if (option == OPT_TIMELINE_CSV) {
+			return new CsvTimeline(filename);
+		} else if (option == OPT_TIMELINE_BIN) {
+			return new BinaryTimeline(filename);
+		}
+		return new ChromeTimeline(filename);
+	} catch (const SimulationError &error) {
+		fprintf(stderr, "ERROR: %s\n", error.what());
 		exit(EXIT_FAILURE);
 	}
-	// read needed execution cycles for floating point instructions
-	getline(in, str, ' ');
-	in >> config["fp_add_sub"];
-	getline(in, str, ' ');
-	in >> config["fp_mul"];
-	getline(in, str, ' ');
-	in >> config["fp_div"];
-	// print configuration
-	printf("Configuration:\n");
-	printf("%26s:%3d\n", "fp adds and subs cycles", config["fp_add_sub"]);
-	printf("%26s:%3d\n", "fp multiplies cycles", config["fp_mul"]);
-	printf("%26s:%3d\n\n\n", "fp divides cycles", config["fp_div"]);
-	in.close();
 }
 
-void getInstructions(vector<Instruction> &instructions, 
-	map<string, int> &config)
+// flush and free the timeline writers
+static void closeTimelines(vector<EventSink*> &timelines)
 {
-	istringstream iss;
+	for (size_t i = 0; i < timelines.size(); ++i) {
+		delete timelines[i];
+	}
+	timelines.clear();
+}
+
+// run a whole trace, or as much of it as the plan says, reporting every 
+// cycle to the timelines and, if given, every window to intervals
+static void simulate(InstructionSource &source, const SimulatorConfig &config, 
+	const vector<EventSink*> &timelines, const CheckpointPlan &plan, 
+	IntervalWriter *intervals, RunStats &stats)
+{
+	Simulator simulator(config, source);
+	long stop = plan.stop_at < 0 ? LONG_MAX : plan.stop_at;
+
+	for (size_t i = 0; i < timelines.size(); ++i) {
+		simulator.addSink(timelines[i]);
+	}
+	if (plan.restore) {
+		simulator.restore(plan.restore);
+	}
+	for (size_t p = 0; p < plan.points.size(); ++p) {
+		if (plan.by_instructions) {
+			// at most one instruction is fetched per cycle
+			while (simulator.stats().instructions < plan.points[p] && 
+			simulator.stats().cycles < stop && simulator.step()) {
+			}
+			if (simulator.stats().instructions < plan.points[p]) {
+				// the trace ended or the run stopped first
+				break;
+			}
+		} else if (plan.points[p] < simulator.stats().cycles) {
+			// already passed in the run the restored checkpoint was from
+			continue;
+		} else {
+			simulator.run(min(plan.points[p], stop) - simulator.stats().cycles);
+			if (simulator.stats().cycles < plan.points[p]) {
+				break;
+			}
+		}
+		if (plan.points.size() == 1) {
+			simulator.save(plan.file);
+		} else {
+			simulator.save((string(plan.file) + "." + to_string(p + 1)).c_str());
+		}
+	}
+	if (intervals) {
+		intervals->run(simulator, stop);
+	} else if (stop == LONG_MAX) {
+		simulator.run();
+	} else if (stop > simulator.stats().cycles) {
+		simulator.run(stop - simulator.stats().cycles);
+	}
+	stats = simulator.stats();
+}
+
+// parse an ascending list of numbers such as "1000,5000,9000"
+static void getPoints(vector<long> &points, const char *spec)
+{
+	string item;
+	istringstream iss(spec);
+
+	while (getline(iss, item, ',')) {
+		char *end;
+		long point = strtol(item.c_str(), &end, 10);
+		if (*end != '\0' || end == item.c_str() || point < 0 || 
+			(!points.empty() && point <= points.back())) {
+			fprintf(stderr, "ERROR: invalid checkpoint list %s\n", spec);
+			exit(EXIT_FAILURE);
+		}
+		points.push_back(point);
+	}
+}
+
+// read the trace paths of a batch, one per line
+static void getTraceList(vector<string> &traces, const char *filename)
+{
+	ifstream list_file;
+	istream *in = &cin;
 	string line;
-	string instruction;
-	string destination_register;
-	string label;
-	string source_register1;
-	string source_register2;
-	char branch_taken;
-	int displacement;
-	int cycles;
-	int i = 1;
-
-	// read in and print instructions
-	printf("Instructions:\n");
-	while (getline(cin, line)) {
-		if (i > 100) {
-			fprintf(stderr, "ERROR: too many instructions in the trace\n");
+
+	if (strcmp(filename, "-") != 0) {
+		list_file.open(filename);
+		if (!list_file) {
+			fprintf(stderr, "ERROR: could not open trace list %s\n", filename);
 			exit(EXIT_FAILURE);
 		}
-		// reset instruction attributes to be read
-		destination_register = "";
-		source_register2 = "";
-		branch_taken = '\0';
-		cycles = 1;
-		// initialize input stringstream with line
-		iss.str(line);
-		// read instruction type
-		iss >> instruction;
-		// ignore whitespace between type and operands
-		iss >> ws;
-		if (instruction == "LW" || instruction == "L.S") {
-			// if instruction is a load, need destination register and 
-			// displacement (in that order)
-			getline(iss, destination_register, ',');
-			iss >> displacement;
-			iss.ignore();
-			getline(iss, source_register1, ')');
-		} else if (instruction == "SW" || instruction == "S.S") {
-			// if instruction is a store, need source register, displacement, and
-			// destination register (in that order)
-			getline(iss, source_register1, ',');
-			iss >> displacement;
-			iss.ignore();
-			getline(iss, destination_register, ')');
-		} else if (instruction == "BEQ" || instruction == "BNE") {
-			// if instruction is a branch, need source registers, the label to
-			// jump to, and whether or not the branch is taken (in that order)
-			getline(iss, source_register1, ',');
-			getline(iss, source_register2, ',');
-			getline(iss, label, ':');
-			iss >> branch_taken;
-		} else if (instruction == "MFC1" || instruction == "MOV.S" || 
-			instruction == "CVT.S.W" || instruction == "CVT.W.S") {
-			// if instruction is data movement (from) or data conversion, need
-			// destination register and source register (in that order)
-			getline(iss, destination_register, ',');
-			iss >> source_register1;
-		} else if (instruction == "MTC1") {
-			// if instruction is data movement (to), need source register and
-			// destination register (in that order)
-			getline(iss, source_register1, ',');
-			iss >> destination_register;
-		} else if (instruction == "DADD" || instruction == "DSUB" || 
-			instruction == "AND" || instruction == "OR" || instruction == "XOR" ||
-			instruction == "ADD.S" || instruction == "SUB.S" || 
-			instruction == "MUL.S" || instruction == "DIV.S") { 
-			// r-type instructions, need destination register and source registers
-			// (in that order)
-			getline(iss, destination_register, ',');
-			getline(iss, source_register1, ',');
-			iss >> source_register2;
-			if (instruction == "ADD.S" || instruction == "SUB.S") {
-				cycles = config["fp_add_sub"];
-			} else if (instruction == "MUL.S") {
-				cycles = config["fp_mul"];
-			} else if (instruction == "DIV.S") {
-				cycles = config["fp_div"];
-			}
-		} else {
-			fprintf(stderr, "ERROR: invalid instruction\n");
+		in = &list_file;
+	}
+	while (getline(*in, line)) {
+		line = trim(line);
+		if (!line.empty()) {
+			traces.push_back(line);
+		}
+	}
+}
+
+// parse a sweep such as "fp_mul=2:8:2,fp_div=10:40", every range starts 
+// out as the config.txt value and is overridden by the spec
+static void getSweep(vector<SweepRange> &ranges, const char *spec)
+{
+	string item;
+	istringstream iss(spec);
+
+	while (getline(iss, item, ',')) {
+		size_t eq = item.find('=');
+		string name = trim(item.substr(0, eq));
+		int first, last, step = 1;
+		int fields = 0;
+		size_t r;
+
+		if (eq != string::npos) {
+			fields = sscanf(item.c_str() + eq + 1, "%d:%d:%d", &first, &last, 
+				&step);
+		}
+		// a latency under one cycle is as invalid here as in config.txt
+		if (fields < 1 || first < 1) {
+			fprintf(stderr, "ERROR: invalid sweep range %s\n", item.c_str());
+			exit(EXIT_FAILURE);
+		} else if (fields == 1) {
+			last = first;
+		}
+		if (last < first || step < 1) {
+			fprintf(stderr, "ERROR: empty sweep range %s\n", item.c_str());
+			exit(EXIT_FAILURE);
+		}
+		for (r = 0; r < ranges.size() && name != ranges[r].name; ++r) {
+		}
+		if (r == ranges.size()) {
+			fprintf(stderr, "ERROR: unknown latency %s\n", name.c_str());
 			exit(EXIT_FAILURE);
 		}
-		// reset stringstream
-		iss.str(string());
-		// clear any error flags
-		iss.clear();
-		// construct and push back instruction
-		instructions.emplace_back(instruction, destination_register, 
-			source_register1, source_register2, branch_taken, cycles, i);
-		// print out instruction
-		printf("%3d. %s\n", i++, line.c_str());
+		ranges[r].first = first;
+		ranges[r].last = last;
+		ranges[r].step = step;
 	}
-	printf("\n\n");
 }
 
-void executeInstructions(vector<Instruction> &instructions)
+// expand the ranges into every combination, the last range varying fastest
+static void getSweepConfigs(vector<SimulatorConfig> &configs, 
+	SimulatorConfig config, const vector<SweepRange> &ranges)
 {
-	// to hold instructions currently in pipeline
-	vector<Instruction> pipeline;
-	// current CPU cycle
-	int current_cycle = 0;
-	// used to fetch instruction
-	int instruction_ptr = 0;
-	// iterators
-	int i;
-	int j;
-	// used to execute correct number of needed stalls
-	int current_stall_cycle = 0;
-	int needed_stall_cycles = 0;
-	// used to determine if next instruction needs to be flushed
-	bool branch_taken = false;
-	bool last_instruction_fetched = false;
-
-	// counters
-	int load_delay_hazard_cycles = 0;
-	int structural_hazard_cycles = 0;
-	int data_hazard_cycles = 0;
-	int total_hazard_cycles;
-	int waw_squashes = 0;
-	int branch_flushes = 0;
-	// hazard statistics
-	float load_delay_hazard_percent;
-	float structural_hazard_percent;
-	float data_hazard_percent;
+	size_t r;
 
-	printf("%5s %5s %5s %5s %5s %5s %5s %5s %5s %5s\n", "cycle", "IF", "ID", 
-		"EX", "MEM", "WB", "FADD", "FMUL", "FDIV", "FWB");
-	printf("----- ----- ----- ----- ----- ----- ----- ----- ----- -----\n");
-
-	do {
-		++current_cycle;
-		// FWB stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (((pipeline[i].stage == "FADD" || pipeline[i].stage == "FMUL" || 
-			pipeline[i].stage == "FDIV") && 
-			pipeline[i].cycles_completed == pipeline[i].cycles_needed) || 
-			(pipeline[i].stage == "MEM" && (pipeline[i].type == "MTC1" || 
-			pipeline[i].type == "CVT.S.W" || pipeline[i].type == "CVT.W.S" || 
-			pipeline[i].type == "MOV.S" || pipeline[i].type == "L.S"))) {
-				// if instruction is ADD.S, SUB.S, MUL.S, or DIV.S and it has 
-				// completed its required cycles, or if it is MTC1, CVT.S.W, 
-				// CVT.W.S, MOV.S, or L.S and it has completed the MEM stage,
-				// write back result
-				printf("%59d\r", pipeline[i].id);
-				// remove from pipeline
-				pipeline.erase(pipeline.begin() + i);
+	for (r = 0; r < ranges.size(); ++r) {
+		config.*ranges[r].latency = ranges[r].first;
+	}
+	for (;;) {
+		configs.push_back(config);
+		// odometer step
+		for (r = ranges.size(); r-- > 0; ) {
+			config.*ranges[r].latency += ranges[r].step;
+			if (config.*ranges[r].latency <= ranges[r].last) {
 				break;
 			}
+			config.*ranges[r].latency = ranges[r].first;
 		}
-		// FDIV stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "ID" && pipeline[i].type == "DIV.S") {
-				if (!pipeline[i].stalled) {
-					// transition DIV.S instruction into FDIV stage
-					pipeline[i].stage = "FDIV";
-					printf("%53d\r", pipeline[i].id);
-					pipeline[i].cycles_completed++;
-					if (pipeline[i].cycles_completed == pipeline[i].cycles_needed
-					&& pipeline[i].result_squashed) {
-						// if instruction has completed, but result has been squashed, 
-						// remove instuction from pipeline (do not want to write back)
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
-			} else if (pipeline[i].stage == "FDIV") {
-				// DIV.S instruction is already executing, but needs additional 
-				// cycle(s) to complete
-				if (!pipeline[i].stalled) {
-					printf("%53d\r", pipeline[i].id);
-					pipeline[i].cycles_completed++;
-					if (pipeline[i].cycles_completed == pipeline[i].cycles_needed 
-					&& pipeline[i].result_squashed) {
-						// if instruction has completed, but result has been squashed, 
-						// remove instuction from pipeline (do not want to write back)
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
-			}
+		if (r == (size_t) -1) {
+			return;
 		}
-		// FMUL stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "ID" && pipeline[i].type == "MUL.S") {
-				if (!pipeline[i].stalled) {
-					// transition MUL.S instruction into FMUL stage
-					pipeline[i].stage = "FMUL";
-					printf("%47d\r", pipeline[i].id);
-					pipeline[i].cycles_completed++;
-					if (pipeline[i].cycles_completed == pipeline[i].cycles_needed 
-					&& pipeline[i].result_squashed) {
-						// if instruction has completed, but result has been squashed, 
-						// remove instuction from pipeline (do not want to write back)
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
-			} else if (pipeline[i].stage == "FMUL") {
-				// MUL.S instruction is already executing, but needs additional 
-				// cycle(s) to complete
-				if (!pipeline[i].stalled) {
-					printf("%47d\r", pipeline[i].id);
-					pipeline[i].cycles_completed++;
-					if (pipeline[i].cycles_completed == pipeline[i].cycles_needed 
-					&& pipeline[i].result_squashed) {
-						// if instruction has completed, but result has been squashed, 
-						// remove instuction from pipeline (do not want to write back)
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{"stream", no_argument, NULL, 's'},
+		{"fast-forward", no_argument, NULL, 'f'},
+		{"loops", no_argument, NULL, 'l'},
+		{"quiet", no_argument, NULL, 'q'},
+		{"timeline-csv", required_argument, NULL, OPT_TIMELINE_CSV},
+		{"timeline-bin", required_argument, NULL, OPT_TIMELINE_BIN},
+		{"timeline-json", required_argument, NULL, OPT_TIMELINE_JSON},
+		{"opcodes", required_argument, NULL, OPT_OPCODES},
+		{"serve", required_argument, NULL, OPT_SERVE},
+		{"batch", required_argument, NULL, 'b'},
+		{"jobs", required_argument, NULL, 'j'},
+		{"sweep", required_argument, NULL, OPT_SWEEP},
+		{"convert", required_argument, NULL, OPT_CONVERT},
+		{"checkpoint", required_argument, NULL, OPT_CHECKPOINT},
+		{"checkpoint-at", required_argument, NULL, OPT_CHECKPOINT_AT},
+		{"checkpoint-after", required_argument, NULL, OPT_CHECKPOINT_AFTER},
+		{"restore", required_argument, NULL, OPT_RESTORE},
+		{"stop-at", required_argument, NULL, OPT_STOP_AT},
+		{"sample", required_argument, NULL, OPT_SAMPLE},
+		{"hotspots", required_argument, NULL, OPT_HOTSPOTS},
+		{"profile", required_argument, NULL, OPT_PROFILE},
+		{"intervals", required_argument, NULL, OPT_INTERVALS},
+		{"interval-cycles", required_argument, NULL, OPT_INTERVAL_CYCLES},
+		{"interval-instructions", required_argument, NULL, 
+			OPT_INTERVAL_INSTRUCTIONS},
+		{NULL, 0, NULL, 0}
+	};
+	SimulatorConfig config;
+	CheckpointPlan plan;
+	SamplingConfig sampling;
+	vector<EventSink*> timelines;
+	vector<EventSink*> sinks;
+	HazardProfile *profile = NULL;
+	vector<DecodedInstruction> instructions;
+	vector<string> traces;
+	RegisterTable registers;
+	RunStats stats;
+	TraceReader trace;
+	BinaryTrace binary;
+	bool is_binary = false;
+	const DecodedInstruction *records;
+	size_t record_count;
+	bool stream = false;
+	bool quiet = false;
+	bool run_only;
+	const char *batch = NULL;
+	const char *sweep = NULL;
+	const char *convert = NULL;
+	const char *serve = NULL;
+	bool sample = false;
+	long hotspots = 0;
+	const char *profile_file = NULL;
+	const char *intervals_file = NULL;
+	long interval = 10000;
+	bool interval_instructions = false;
+	IntervalWriter *intervals = NULL;
+	int jobs = thread::hardware_concurrency();
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "sflqb:j:", long_options, NULL)) 
+	!= -1) {
+		switch (opt) {
+		case 's':
+			// fetch instructions on demand instead of loading the whole trace
+			stream = true;
+			break;
+		case 'f':
+			// jump over cycles in which only stalls and FP units progress
+			config.fast_forward = true;
+			break;
+		case 'l':
+			// jump over repeated loop iterations, only without a timeline 
+			// and for traces held in memory
+			config.extrapolate_loops = true;
+			break;
+		case 'q':
+			// print only the hazard statistics
+			quiet = true;
+			break;
+		case OPT_TIMELINE_CSV:
+			timelines.push_back(openTimeline(opt, optarg));
+			break;
+		case OPT_TIMELINE_BIN:
+			timelines.push_back(openTimeline(opt, optarg));
+			break;
+		case OPT_SERVE:
+			// stay resident and take jobs from a Unix domain socket
+			serve = optarg;
+			break;
+		case OPT_OPCODES:
+			// change or add opcodes before any trace is decoded
+			try {
+				loadOpcodes(optarg);
+			} catch (const SimulationError &error) {
+				fprintf(stderr, "ERROR: %s\n", error.what());
+				exit(EXIT_FAILURE);
 			}
-		}
-		// FADD stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "ID" && (pipeline[i].type == "ADD.S" ||
-				pipeline[i].type == "SUB.S")) {
-				if (!pipeline[i].stalled) {
-					// transition ADD.S or SUB.S instruction into FADD stage
-					pipeline[i].stage = "FADD";
-					printf("%41d\r", pipeline[i].id);
-					pipeline[i].cycles_completed++;
-					if (pipeline[i].cycles_completed == pipeline[i].cycles_needed 
-					&& pipeline[i].result_squashed) {
-						// if instruction has completed, but result has been squashed, 
-						// remove instuction from pipeline (do not want to write back)
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
-			} else if (pipeline[i].stage == "FADD") {
-				// ADD.S or SUB.S instruction is already executing, but needs
-				// additional cycle(s) to complete
-				if (!pipeline[i].stalled) {
-					printf("%41d\r", pipeline[i].id);
-					pipeline[i].cycles_completed++;
-					if (pipeline[i].cycles_completed == pipeline[i].cycles_needed 
-					&& pipeline[i].result_squashed) {
-						// if instruction has completed, but result has been squashed, 
-						// remove instuction from pipeline (do not want to write back)
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
+			break;
+		case OPT_TIMELINE_JSON:
+			// for trace viewers, written on a thread of its own
+			timelines.push_back(openTimeline(opt, optarg));
+			break;
+		case 'b':
+			// simulate every trace in a list and report them together
+			batch = optarg;
+			break;
+		case 'j':
+			// number of threads simulating batch traces
+			jobs = atoi(optarg);
+			if (jobs < 1) {
+				usage();
 			}
-		}
-		// WB stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "MEM") {
-				if (!pipeline[i].stalled) {
-					// instruction completed, write back result
-					printf("%35d\r", pipeline[i].id);
-					// remove from pipeline
-					pipeline.erase(pipeline.begin() + i);
-				}
-				break;
+			break;
+		case OPT_SWEEP:
+			// simulate one trace under a range of latencies
+			sweep = optarg;
+			break;
+		case OPT_CONVERT:
+			// write the trace in binary form instead of simulating it
+			convert = optarg;
+			break;
+		case OPT_CHECKPOINT:
+			// save the simulator state at the points given below
+			plan.file = optarg;
+			break;
+		case OPT_CHECKPOINT_AT:
+			if (!plan.points.empty()) {
+				usage();
 			}
-		}
-		// MEM stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "EX") {
-				if (!pipeline[i].stalled) {
-					// transition instruction from EX stage to MEM
-					pipeline[i].stage = "MEM";
-					printf("%29d\r", pipeline[i].id);
-					if (pipeline[i].type == "SW" || pipeline[i].type == "S.S") {
-						// store instructions complete in MEM stage, remove from
-						// pipeline
-						pipeline.erase(pipeline.begin() + i);
-					}
-				}
-				break;
+			getPoints(plan.points, optarg);
+			break;
+		case OPT_CHECKPOINT_AFTER:
+			if (!plan.points.empty()) {
+				usage();
+			}
+			getPoints(plan.points, optarg);
+			plan.by_instructions = true;
+			break;
+		case OPT_RESTORE:
+			// resume from a checkpoint of the same trace
+			plan.restore = optarg;
+			break;
+		case OPT_STOP_AT:
+			// simulate only up to a cycle, such as the next checkpoint
+			plan.stop_at = atol(optarg);
+			if (plan.stop_at < 0) {
+				usage();
+			}
+			break;
+		case OPT_SAMPLE:
+			// estimate the statistics from windows of the trace
+			if (sscanf(optarg, "%ld,%ld,%ld", &sampling.interval, 
+				&sampling.window, &sampling.warmup) < 1 || 
+				sampling.window < 1 || sampling.warmup < 0 || 
+				sampling.interval < sampling.window + sampling.warmup) {
+				fprintf(stderr, "ERROR: invalid sampling %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			sample = true;
+			break;
+		case OPT_HOTSPOTS:
+			// print the instructions that stall or cause stalls the most
+			hotspots = atol(optarg);
+			if (hotspots < 1) {
+				usage();
 			}
+			break;
+		case OPT_PROFILE:
+			// write the hazards of every instruction as CSV
+			profile_file = optarg;
+			break;
+		case OPT_INTERVALS:
+			// write statistics for every window of the run as CSV
+			intervals_file = optarg;
+			break;
+		case OPT_INTERVAL_CYCLES:
+		case OPT_INTERVAL_INSTRUCTIONS:
+			interval = atol(optarg);
+			interval_instructions = opt == OPT_INTERVAL_INSTRUCTIONS;
+			if (interval < 1) {
+				usage();
+			}
+			break;
+		default:
+			usage();
 		}
-		// EX stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "ID") {
-				if (!pipeline[i].stalled) {
-					// transition instruction from ID stage to EX
-					pipeline[i].stage = "EX";
-					printf("%23d\r", pipeline[i].id);
-				}
-				break;
+	}
+	if (jobs < 1) {
+		jobs = 1;
+	}
+	if (!plan.file != plan.points.empty()) {
+		usage();
+	}
+	// options that only apply to simulating a single trace in full
+	run_only = plan.file || plan.restore || plan.stop_at >= 0 || hotspots || 
+		profile_file || intervals_file;
+	if (intervals_file && plan.file) {
+		// windows are written from the last checkpoint on
+		usage();
+	}
+
+	if (serve) {
+		if (optind != argc || batch || sweep || convert || sample || stream || 
+			!timelines.empty() || run_only) {
+			usage();
+		}
+		getConfig(config, "config.txt", false);
+		setUnattended(config);
+		try {
+			SimulationServer server(config, jobs);
+			server.serve(serve);
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
+		return 0;
+	}
+
+	if (batch) {
+		if (optind != argc || sweep || convert || sample || 
+			!timelines.empty() || run_only) {
+			usage();
+		}
+		getTraceList(traces, batch);
+		getConfig(config, "config.txt", false);
+		setUnattended(config);
+		return runBatch(traces, config, jobs) ? 0 : EXIT_FAILURE;
+	}
+
+	if (optind < argc - 1) {
+		usage();
+	} else if (optind == argc - 1) {
+		// read trace from file instead of stdin
+		try {
+			is_binary = binary.open(argv[optind], registers);
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s: %s\n", argv[optind], error.what());
+			exit(EXIT_FAILURE);
+		}
+		if (!is_binary && !trace.open(argv[optind])) {
+			fprintf(stderr, "ERROR: could not open trace file %s\n", 
+				argv[optind]);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		trace.attach(STDIN_FILENO);
+	}
+
+	if (convert) {
+		if (is_binary || sweep || sample || stream || !timelines.empty() || 
+			run_only) {
+			usage();
+		}
+		try {
+			convertTrace(trace, registers, convert);
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
+		return 0;
+	}
+
+	if (sweep) {
+		vector<SweepRange> ranges(3);
+		vector<SimulatorConfig> configs;
+
+		if (sample || stream || !timelines.empty() || run_only) {
+			usage();
+		}
+		getConfig(config, "config.txt", false);
+		ranges[0].name = "fp_add_sub";
+		ranges[0].latency = &SimulatorConfig::fp_add_sub;
+		ranges[1].name = "fp_mul";
+		ranges[1].latency = &SimulatorConfig::fp_mul;
+		ranges[2].name = "fp_div";
+		ranges[2].latency = &SimulatorConfig::fp_div;
+		for (size_t r = 0; r < ranges.size(); ++r) {
+			ranges[r].first = ranges[r].last = config.*ranges[r].latency;
+			ranges[r].step = 1;
+		}
+		getSweep(ranges, sweep);
+		setUnattended(config);
+		getSweepConfigs(configs, config, ranges);
+		if (is_binary) {
+			records = binary.records();
+			record_count = binary.size();
+		} else {
+			try {
+				// the trace is decoded once and shared by every configuration
+				getInstructions(instructions, registers, trace, false, 0);
+			} catch (const SimulationError &error) {
+				fprintf(stderr, "ERROR: %s\n", error.what());
+				exit(EXIT_FAILURE);
 			}
+			records = instructions.data();
+			record_count = instructions.size();
 		}
-		// execute needed stalls
-		if (current_stall_cycle != needed_stall_cycles) {
-			if (!last_instruction_fetched) {
-				printf("%5d %5s %5s\n", current_cycle, "stall", "stall");
+		return runSweep(records, record_count, configs, jobs) ? 0 : 
+			EXIT_FAILURE;
+	}
+
+	if (sample) {
+		SampleEstimate estimate;
+
+		if (stream || !timelines.empty() || run_only) {
+			usage();
+		}
+		getConfig(config, "config.txt", false);
+		try {
+			if (is_binary) {
+				RecordSource source(binary.records(), binary.size());
+				sampleTrace(source, config, sampling, estimate);
 			} else {
-				// last instruction was fetched, only need to stall in ID stage
-				printf("%5d %11s\n", current_cycle, "stall");
-			}
-			if (++current_stall_cycle == needed_stall_cycles) {
-				// needed stall(s) have been executed
-				// reset stall counters
-				current_stall_cycle = 0;
-				needed_stall_cycles = 0;
-				for (i = 0; i < pipeline.size(); ++i) {
-					// unstall the instruction that needed the stall(s)
-					if (pipeline[i].stalled) {
-						pipeline[i].stalled = false;
-					}
-				}
+				// the trace is never held in memory, skipped parts are 
+				// parsed ahead on another thread
+				PrefetchSource source(trace, registers);
+				sampleTrace(source, config, sampling, estimate);
 			}
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
+		printEstimate(estimate, sampling);
+		return 0;
+	}
+
+	if (!quiet) {
+		timelines.insert(timelines.begin(), 
+			new TerminalTimeline);
+	}
+
+	getConfig(config, "config.txt", !quiet);
+	sinks = timelines;
+	if (intervals_file) {
+		try {
+			intervals = new IntervalWriter(intervals_file, interval, 
+				interval_instructions);
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (hotspots || profile_file) {
+		profile = new HazardProfile(registers);
+		sinks.push_back(profile);
+	}
+	try {
+		if (is_binary) {
+			// already decoded, nothing to list and no need to load it first
+			RecordSource source(binary.records(), binary.size());
+			simulate(source, config, sinks, plan, intervals, stats);
+		} else if (stream && config.extrapolate_loops) {
+			// loops are looked for in a window of the stream
+			PrefetchSource prefetch(trace, registers);
+			WindowSource source(prefetch);
+			simulate(source, config, sinks, plan, intervals, stats);
+		} else if (stream) {
+			// parsing overlaps with simulation
+			PrefetchSource source(trace, registers);
+			simulate(source, config, sinks, plan, intervals, stats);
+		} else {
+			getInstructions(instructions, registers, trace, !quiet, 100);
+			RecordSource source(instructions.data(), instructions.size());
+			simulate(source, config, sinks, plan, intervals, stats);
+		}
+	} catch (const SimulationError &error) {
+		closeTimelines(timelines);
+		delete intervals;
+		fflush(stdout);
+		fprintf(stderr, "ERROR: %s\n", error.what());
+		exit(EXIT_FAILURE);
+	}
+	closeTimelines(timelines);
+	delete intervals;
+	printStatistics(stats, quiet);
+	if (hotspots) {
+		profile->printHotSpots(hotspots);
+	}
+	if (profile_file) {
+		try {
+			profile->writeCsv(profile_file);
+		} catch (const SimulationError &error) {
+			fprintf(stderr, "ERROR: %s\n", error.what());
+			exit(EXIT_FAILURE);
+		}
+	}
+	delete profile;
+	return 0;
+}
+
+void getConfig(SimulatorConfig &config, const char *filename, bool echo)
+{
+	static const char *const unit_names[NUM_FP_UNITS] = {
+		"fadd", "fmul", "fdiv"
+	};
+	// open configuration file
+	ifstream in(filename);
+	string str;
+	// check if file failed to open
+	if (!in) {
+		fprintf(stderr, "ERROR: could not open config file %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	// read needed execution cycles for floating point instructions
+	getline(in, str, ' ');
+	in >> config.fp_add_sub;
+	getline(in, str, ' ');
+	in >> config.fp_mul;
+	getline(in, str, ' ');
+	in >> config.fp_div;
+	getline(in, str);
+	// optional lines describing the FP units, such as "fmul_units: 2", 
+	// "fmul_pipelined: 1" and "fmul_interval: 1"
+	while (getline(in, str)) {
+		size_t colon = str.find(':');
+		string name = trim(str.substr(0, colon));
+		char *end;
+		long value;
+		int unit;
+
+		if (name.empty() && colon == string::npos) {
 			continue;
 		}
-		// ID stage
-		for (i = 0; i < pipeline.size(); ++i) {
-			if (pipeline[i].stage == "IF") {
-				// transition instruction from IF stage to ID
-				pipeline[i].stage = "ID";
-				printf("%17d\r", pipeline[i].id);
-				if (pipeline[i].id == instructions.size()) {
-					// this is the last instruction, so any stalls will happen only
-					// in future ID stages
-					last_instruction_fetched = true;
-				}
-				if (pipeline[i].type == "BEQ" || pipeline[i].type == "BNE") {
-					if (pipeline[i].branch_taken == 'T') {
-						// needed to flush fetched instruction
-						branch_taken = true;
-					}
-					// branch instructions complete in ID stage, remove from pipeline
-					pipeline.erase(pipeline.begin() + i);
-				}
-				for (j = i - 1; j >= 0; --j) {
-					// check for WAW (current instruction will write to same FP reg 
-					// before an executing instuction)
-					if (pipeline[i].destination_register[0] == 'F' 
-					&& pipeline[i].destination_register == 
-					pipeline[j].destination_register && pipeline[i].cycles_needed 
-					< (pipeline[j].cycles_needed - pipeline[j].cycles_completed)) {
-						// squash result (prevent it from be written to FP reg)
-						pipeline[j].result_squashed = true;
-						++waw_squashes;
-					}
-					// check for a structural hazard (required functional unit is 
-					// being used by executing instruction)
-					if ((((pipeline[i].type == "ADD.S" || 
-					pipeline[i].type == "SUB.S") && pipeline[j].stage == "FADD") ||
-					(pipeline[i].type == "MUL.S" && pipeline[j].stage == "FMUL") ||
-					(pipeline[i].type == "DIV.S" && pipeline[j].stage == "FDIV")) && 
-					pipeline[j].cycles_completed != pipeline[j].cycles_needed) {
-						// needed stall cycles is the number of cycles the culprit
-						// instruction still needs
-						needed_stall_cycles = pipeline[j].cycles_needed - 
-						pipeline[j].cycles_completed;
-						if (needed_stall_cycles < 0) {
-							// if culprit instruction will complete, don't need to
-							// stall
-							needed_stall_cycles = 0;
-							break;
-						}
-						// stall current instruction
-						pipeline[i].stalled = true;
-						structural_hazard_cycles += needed_stall_cycles;
-						break;
-					}
-					// check for a load hazard or a data hazard
-					if (pipeline[j].destination_register == 
-					pipeline[i].destination_register && (pipeline[j].type == "LW"
-					|| pipeline[j].type == "L.S") && (pipeline[i].type == "SW" ||
-					pipeline[i].type == "S.S")) {
-						// load hazard: store instruction needs value of load
-						// instruction's destination register to write to memory
-						needed_stall_cycles = 1;
-						load_delay_hazard_cycles += needed_stall_cycles;
-						// stall current instruction
-						pipeline[i].stalled = true;
-						break;
-					}
-					if (pipeline[j].destination_register == 
-					pipeline[i].source_register1 || 
-					pipeline[j].destination_register == 
-					pipeline[i].source_register2) {
-						if (pipeline[j].type == "LW" || pipeline[j].type == "L.S") {
-							if (pipeline[i].type == "SW" || 
-							pipeline[i].type == "S.S") {
-								// not a load hazard: store instruction does not write 
-								// to memory until MEM stage, at which time the value of 
-								// the load instruction's destination register will be 
-								// available
-								continue;
-							}
-							// load hazard: instruction needs value of load
-							// instruction's destination register to execute
-							// only need one stall cycle
-							needed_stall_cycles = 1;
-							load_delay_hazard_cycles += needed_stall_cycles;
-							// stall current instruction
-							pipeline[i].stalled = true;
-						} else {
-							// data hazard: instruction needs value of previous 
-							// instruction's destination register to execute
-							if (pipeline[i].type == "BEQ" || 
-							pipeline[i].type == "BNE") {
-								// branch instructions are resolved in ID stage, so need
-								// to stall for source register value (1 cycle)
-								needed_stall_cycles = 1;
-								// stall current instruction
-								pipeline[i].stalled = true;
-							} else if (pipeline[j].type == "ADD.S" || 
-							pipeline[j].type == "SUB.S" || 
-							pipeline[j].type == "MUL.S" ||
-							pipeline[j].type == "DIV.S") {
-								// needed stall cycles is the numer of cycles the
-								// culprit instruction still needs
-								needed_stall_cycles = pipeline[j].cycles_needed - 
-								pipeline[j].cycles_completed;
-								if (pipeline[i].type == "SW" || 
-								pipeline[i].type == "S.S") {
-									// needed stall cycles is one less because store 
-									// instruction doesn't write to memory until MEM 
-									// stage
-									needed_stall_cycles -= 1;
-									if (needed_stall_cycles < 0) {
-										// if instruction will complete, though, don't
-										// need to stall
-										needed_stall_cycles = 0;
-										break;
-									}
-								}
-								// stall current instruction
-								pipeline[i].stalled = true;
-							}
-							data_hazard_cycles += needed_stall_cycles;
-						}
-						break;
-					}
-				}
+		value = colon == string::npos ? 0 : 
+			strtol(str.c_str() + colon + 1, &end, 10);
+		for (unit = 0; unit < NUM_FP_UNITS; ++unit) {
+			if (name.compare(0, 4, unit_names[unit]) == 0) {
 				break;
 			}
 		}
-		// IF stage
-		if (instruction_ptr < instructions.size()) {
-			// fetch next instruction, place it in pipeline
-			pipeline.push_back(instructions[instruction_ptr++]);
-			// indicate that it's currently in the IF stage
-			pipeline.back().stage = "IF";
-			// print its identifier
-			printf("%11d\r", pipeline.back().id);
-			// if branch is taken, need to flush fetched instruction
-			if (branch_taken) {
-				pipeline.erase(pipeline.end()-1);
-				++branch_flushes;
-				// reset flag
-				branch_taken = false;
-			}
+		if (colon == string::npos || end == str.c_str() + colon + 1 || 
+			!trim(end).empty() || unit == NUM_FP_UNITS) {
+			fprintf(stderr, "ERROR: invalid config line %s\n", str.c_str());
+			exit(EXIT_FAILURE);
+		}
+		if (name.substr(4) == "_units" && value >= 1 && value <= INT_MAX) {
+			config.units[unit].count = value;
+		} else if (name.substr(4) == "_pipelined" && 
+			(value == 0 || value == 1)) {
+			config.units[unit].pipelined = value;
+		} else if (name.substr(4) == "_interval" && value >= 1 && 
+			value <= INT_MAX) {
+			config.units[unit].interval = value;
+		} else {
+			fprintf(stderr, "ERROR: invalid config line %s\n", str.c_str());
+			exit(EXIT_FAILURE);
+		}
+	}
+	in.close();
+	if (!echo) {
+		return;
+	}
+	// print configuration, and the FP units where they differ from a single 
+	// copy that is not pipelined
+	printf("Configuration:\n");
+	printf("%26s:%3d\n", "fp adds and subs cycles", config.fp_add_sub);
+	printf("%26s:%3d\n", "fp multiplies cycles", config.fp_mul);
+	printf("%26s:%3d\n", "fp divides cycles", config.fp_div);
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		const FpUnitConfig &fp = config.units[unit];
+
+		if (fp.count != 1) {
+			printf("%26s:%3d\n", (string(unit_names[unit]) + " units").c_str(), 
+				fp.count);
+		}
+		if (fp.pipelined) {
+			printf("%26s:%3d\n", (string(unit_names[unit]) + 
+				" pipelined, interval").c_str(), fp.interval);
 		}
-		printf("%5d\n", current_cycle);
-	} while (!pipeline.empty());
+	}
+	printf("\n\n");
+}
+
+void printStatistics(const RunStats &stats, bool quiet)
+{
+	long total_hazard_cycles;
+	// hazard statistics
+	float load_delay_hazard_percent;
+	float structural_hazard_percent;
+	float data_hazard_percent;
 
 	// calculate percent of hazard cycles for each type of hazard, provided
 	// total_hazard_cycles > 0
-	total_hazard_cycles = load_delay_hazard_cycles + structural_hazard_cycles 
-	+ data_hazard_cycles;
+	total_hazard_cycles = stats.load_delay_hazard_cycles + 
+	stats.structural_hazard_cycles + stats.data_hazard_cycles;
 	if (total_hazard_cycles > 0) {
-		load_delay_hazard_percent = (static_cast<float>(load_delay_hazard_cycles) 
+		load_delay_hazard_percent = 
+		(static_cast<float>(stats.load_delay_hazard_cycles) 
 		/ total_hazard_cycles) * 100.0;
-		structural_hazard_percent = (static_cast<float>(structural_hazard_cycles) 
+		structural_hazard_percent = 
+		(static_cast<float>(stats.structural_hazard_cycles) 
 		/ total_hazard_cycles) * 100.0;
-		data_hazard_percent = (static_cast<float>(data_hazard_cycles) 
+		data_hazard_percent = (static_cast<float>(stats.data_hazard_cycles) 
 		/ total_hazard_cycles) * 100.0;
 	} else {
 		load_delay_hazard_percent = 0.0;
@@ -557,24 +809,314 @@ void executeInstructions(vector<Instruction> &instructions)
 		data_hazard_percent = 0.0;
 	}
 
+	// without the timeline nothing else says how long the run took
+	if (quiet) {
+		printf("cycles: %ld\n", stats.cycles);
+		printf("instructions: %ld\n", stats.instructions);
+		printf("CPI: %.3f\n", stats.instructions > 0 ? 
+			static_cast<double>(stats.cycles) / stats.instructions : 0.0);
+	}
+
 	// print statistics
 	printf("\nhazard type  cycles  %% of stalls  %% of total\n");
 	printf("-----------  ------  -----------  ----------\n");
-	printf("%-11s  %6d  %11.2f  %10.2f\n", "load-delay", 
-		load_delay_hazard_cycles, load_delay_hazard_percent, 
-		(static_cast<float>(load_delay_hazard_cycles) / current_cycle) * 100.0);
-	printf("%-11s  %6d  %11.2f  %10.2f\n", "structural", 
-		structural_hazard_cycles, structural_hazard_percent, 
-		(static_cast<float>(structural_hazard_cycles) / current_cycle) * 100.0);
-	printf("%-11s  %6d  %11.2f  %10.2f\n", "data", data_hazard_cycles, 
+	printf("%-11s  %6ld  %11.2f  %10.2f\n", "load-delay", 
+		stats.load_delay_hazard_cycles, load_delay_hazard_percent, 
+		(static_cast<float>(stats.load_delay_hazard_cycles) / stats.cycles) * 
+		100.0);
+	printf("%-11s  %6ld  %11.2f  %10.2f\n", "structural", 
+		stats.structural_hazard_cycles, structural_hazard_percent, 
+		(static_cast<float>(stats.structural_hazard_cycles) / stats.cycles) * 
+		100.0);
+	printf("%-11s  %6ld  %11.2f  %10.2f\n", "data", stats.data_hazard_cycles, 
 		data_hazard_percent, 
-		(static_cast<float>(data_hazard_cycles) / current_cycle) * 100.0);
+		(static_cast<float>(stats.data_hazard_cycles) / stats.cycles) * 100.0);
 	printf("-----------  ------  -----------  ----------\n");
-	printf("%-11s  %6d  %11.2f  %10.2f\n", "total", total_hazard_cycles, 
+	printf("%-11s  %6ld  %11.2f  %10.2f\n", "total", total_hazard_cycles, 
 		load_delay_hazard_percent + structural_hazard_percent + 
 		data_hazard_percent, 
-		(static_cast<float>(total_hazard_cycles) / current_cycle) * 100.0);
+		(static_cast<float>(total_hazard_cycles) / stats.cycles) * 100.0);
+
+	printf("\nWAW squashes: %ld\n", stats.waw_squashes);
+	printf("branch flushes: %ld\n", stats.branch_flushes);
+}
+
+void printEstimate(const SampleEstimate &estimate, 
+	const SamplingConfig &sampling)
+{
+	printf("%ld windows of %ld instructions, one every %ld of %ld "
+		"instructions\n\n", estimate.samples, sampling.window, 
+		sampling.interval, estimate.instructions);
+	if (estimate.dropped) {
+		printf("%ld more windows left out, the pipeline ran empty in them\n\n", 
+			estimate.dropped);
+	}
+	printf("%-14s  %14s  %s\n", "quantity", "estimate", "95% confidence");
+	printf("--------------  --------------  --------------------\n");
+	for (int q = 0; q < NUM_SAMPLED; ++q) {
+		printf("%-14s  %14.0f  ", sampled_names[q], estimate.total[q]);
+		if (estimate.error[q] < 0) {
+			printf("unknown\n");
+		} else if (estimate.total[q] > 0) {
+			printf("+/- %.0f (%.2f%%)\n", estimate.error[q], 
+				estimate.error[q] / estimate.total[q] * 100.0);
+		} else {
+			printf("+/- %.0f\n", estimate.error[q]);
+		}
+	}
+}
+
+void WorkStealingPool::run(size_t tasks, const function<void(size_t)> &task)
+{
+	vector<thread> threads;
+	size_t n = queues.size();
+
+	for (size_t t = 0; t < n; ++t) {
+		for (size_t i = t * tasks / n; i < (t + 1) * tasks / n; ++i) {
+			queues[t].tasks.push_back(i);
+		}
+	}
+	for (size_t t = 0; t < n; ++t) {
+		threads.push_back(thread([this, t, &task]() {
+			size_t i;
+			while (take(t, i)) {
+				task(i);
+			}
+		}));
+	}
+	for (size_t t = 0; t < n; ++t) {
+		threads[t].join();
+	}
+}
+
+bool WorkStealingPool::take(size_t self, size_t &task)
+{
+	size_t n = queues.size();
+
+	{
+		lock_guard<mutex> guard(queues[self].lock);
+		if (!queues[self].tasks.empty()) {
+			task = queues[self].tasks.front();
+			queues[self].tasks.pop_front();
+			return true;
+		}
+	}
+	// own share is done, steal from the others
+	for (size_t k = 1; k < n; ++k) {
+		Queue &victim = queues[(self + k) % n];
+		lock_guard<mutex> guard(victim.lock);
+		if (!victim.tasks.empty()) {
+			task = victim.tasks.back();
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+	// no tasks are ever added, so every queue stays empty from now on
+	return false;
+}
+
+bool runBatch(const vector<string> &traces, const SimulatorConfig &config, 
+	int jobs)
+{
+	vector<RunStats> results(traces.size());
+	vector<string> errors(traces.size());
+	WorkStealingPool pool(jobs);
+	RunStats total;
+	bool ok = true;
+
+	pool.run(traces.size(), [&](size_t t) {
+		TraceReader in;
+		BinaryTrace binary;
+		RegisterTable registers;
+		try {
+			if (binary.open(traces[t].c_str(), registers)) {
+				RecordSource source(binary.records(), binary.size());
+				Simulator simulator(config, source);
+				simulator.run();
+				results[t] = simulator.stats();
+			} else if (!in.open(traces[t].c_str())) {
+				errors[t] = "could not open trace file";
+			} else {
+				// the window lets -l find loops in the stream
+				StreamSource stream(in, registers);
+				WindowSource source(stream);
+				Simulator simulator(config, source);
+				simulator.run();
+				results[t] = simulator.stats();
+			}
+		} catch (const SimulationError &error) {
+			errors[t] = error.what();
+		}
+	});
+
+	// print one line per trace and the totals over all successful ones
+	printf("%12s %12s %10s %10s %10s %8s %8s  %s\n", "cycles", "instructions", 
+		"load-delay", "structural", "data", "WAW", "flushes", "trace");
+	for (size_t t = 0; t < traces.size(); ++t) {
+		if (!errors[t].empty()) {
+			fprintf(stderr, "ERROR: %s: %s\n", traces[t].c_str(), 
+				errors[t].c_str());
+			ok = false;
+			continue;
+		}
+		printf("%12ld %12ld %10ld %10ld %10ld %8ld %8ld  %s\n", 
+			results[t].cycles, results[t].instructions, 
+			results[t].load_delay_hazard_cycles, 
+			results[t].structural_hazard_cycles, results[t].data_hazard_cycles, 
+			results[t].waw_squashes, results[t].branch_flushes, 
+			traces[t].c_str());
+		total.cycles += results[t].cycles;
+		total.instructions += results[t].instructions;
+		total.load_delay_hazard_cycles += results[t].load_delay_hazard_cycles;
+		total.structural_hazard_cycles += results[t].structural_hazard_cycles;
+		total.data_hazard_cycles += results[t].data_hazard_cycles;
+		total.waw_squashes += results[t].waw_squashes;
+		total.branch_flushes += results[t].branch_flushes;
+	}
+	printf("%12ld %12ld %10ld %10ld %10ld %8ld %8ld  %s\n", total.cycles, 
+		total.instructions, total.load_delay_hazard_cycles, 
+		total.structural_hazard_cycles, total.data_hazard_cycles, 
+		total.waw_squashes, total.branch_flushes, "total");
+	return ok;
+}
+
+bool runSweep(const DecodedInstruction *records, size_t count, 
+	const vector<SimulatorConfig> &configs, int jobs)
+{
+	vector<RunStats> results;
+	vector<string> errors;
+	// configuration simulated for each one, and the index of its result
+	vector<size_t> simulated;
+	vector<size_t> result(configs.size());
+	map<vector<int>, size_t> seen;
+	vector<SweepBranch> branches;
+	bool present[MAX_OPCODES] = {};
+	bool used[NUM_STAGES] = {};
+	WorkStealingPool pool(jobs);
+	bool ok = true;
 
-	printf("\nWAW squashes: %d\n", waw_squashes);
-	printf("branch flushes: %d\n", branch_flushes);
-}
\ No newline at end of file
+	// the latency of an FP unit makes no difference to a trace that never 
+	// uses it, so configurations that differ only in such latencies are 
+	// simulated once; a single pass over the trace finds the units it uses
+	for (size_t i = 0; i < count; ++i) {
+		present[records[i].opcode] = true;
+	}
+	for (int op = 0; op < opcode_count; ++op) {
+		if (present[op] && !opcodes[op].latency) {
+			used[opcodes[op].unit] = true;
+		}
+	}
+	for (size_t c = 0; c < configs.size(); ++c) {
+		vector<int> key(3);
+		key[0] = used[STAGE_FADD] ? configs[c].fp_add_sub : 0;
+		key[1] = used[STAGE_FMUL] ? configs[c].fp_mul : 0;
+		key[2] = used[STAGE_FDIV] ? configs[c].fp_div : 0;
+		auto it = seen.insert(make_pair(key, simulated.size()));
+		if (it.second) {
+			simulated.push_back(c);
+		}
+		result[c] = it.first->second;
+	}
+	results.resize(simulated.size());
+	errors.resize(simulated.size());
+	// the configurations run as one until the first instruction whose 
+	// latency tells them apart; there they split by that latency, each group 
+	// carrying on from a copy of the state reached so far, until every group 
+	// is a single configuration run to the end
+	branches.push_back(SweepBranch());
+	for (size_t r = 0; r < simulated.size(); ++r) {
+		branches.back().members.push_back(r);
+	}
+	while (!branches.empty()) {
+		vector<SweepBranch> next;
+		mutex next_lock;
+
+		pool.run(branches.size(), [&](size_t b) {
+			const SweepBranch &branch = branches[b];
+			const SimulatorConfig &config = 
+				configs[simulated[branch.members[0]]];
+			SweepBranch split;
+			map<int, vector<size_t>> groups;
+			size_t at;
+			int op;
+
+			split.source = make_shared<RecordSource>(records, count);
+			try {
+				if (branch.simulator) {
+					split.source->skip(branch.simulator->stats().instructions);
+					split.simulator = make_shared<Simulator>(*branch.simulator, 
+						config, *split.source);
+				} else {
+					split.simulator = make_shared<Simulator>(config, 
+						*split.source);
+				}
+				// find the next instruction the members disagree on
+				for (at = split.simulator->stats().instructions; 
+				branch.members.size() > 1 && at < count; ++at) {
+					op = records[at].opcode;
+					for (size_t m = 1; m < branch.members.size(); ++m) {
+						if (opcodeLatency(configs[simulated[branch.members[m]]], 
+						op) != opcodeLatency(config, op)) {
+							break;
+						}
+						if (m == branch.members.size() - 1) {
+							op = -1;
+						}
+					}
+					if (op >= 0) {
+						break;
+					}
+				}
+				if (branch.members.size() == 1 || at == count || 
+				!split.simulator->runFetched(at)) {
+					// nothing left to tell the members apart
+					split.simulator->run();
+					for (size_t m = 0; m < branch.members.size(); ++m) {
+						results[branch.members[m]] = split.simulator->stats();
+					}
+					return;
+				}
+			} catch (const SimulationError &error) {
+				for (size_t m = 0; m < branch.members.size(); ++m) {
+					errors[branch.members[m]] = error.what();
+				}
+				return;
+			}
+			for (size_t m = 0; m < branch.members.size(); ++m) {
+				groups[opcodeLatency(configs[simulated[branch.members[m]]], 
+					op)].push_back(branch.members[m]);
+			}
+			lock_guard<mutex> guard(next_lock);
+			for (auto &group : groups) {
+				next.push_back(split);
+				next.back().members.swap(group.second);
+			}
+		});
+		branches.swap(next);
+	}
+
+	// print one line per configuration
+	printf("%10s %6s %6s %12s %7s %10s %10s %10s %8s %8s\n", "fp_add_sub", 
+		"fp_mul", "fp_div", "cycles", "CPI", "load-delay", "structural", 
+		"data", "WAW", "flushes");
+	for (size_t c = 0; c < configs.size(); ++c) {
+		const SimulatorConfig &config = configs[c];
+		const RunStats &stats = results[result[c]];
+
+		if (!errors[result[c]].empty()) {
+			fprintf(stderr, "ERROR: fp_add_sub=%d fp_mul=%d fp_div=%d: %s\n", 
+				config.fp_add_sub, config.fp_mul, config.fp_div, 
+				errors[result[c]].c_str());
+			ok = false;
+			continue;
+		}
+		printf("%10d %6d %6d %12ld %7.3f %10ld %10ld %10ld %8ld %8ld\n", 
+			config.fp_add_sub, config.fp_mul, config.fp_div, 
+			stats.cycles, stats.instructions > 0 ? 
+			static_cast<double>(stats.cycles) / stats.instructions : 
+			0.0, stats.load_delay_hazard_cycles, 
+			stats.structural_hazard_cycles, stats.data_hazard_cycles, 
+			stats.waw_squashes, stats.branch_flushes);
+	}
+	return ok;
+}
@@ -0,0 +1,303 @@
+#include "pipeline.h"
+#include "checkpoint.h"
+
+#include <algorithm>
+using namespace std;
+
+static bool isUnit(int stage)
+{
+	return stage >= STAGE_FADD && stage <= STAGE_FDIV;
+}
+
+// take an instruction off the latch or list of the stage it is in
+void Pipeline::leave(long seq, int stage)
+{
+	if (stage == STAGE_ID) {
+		decoding.erase(find(decoding.begin(), decoding.end(), seq));
+	} else if (isUnit(stage)) {
+		vector<long> &unit = units[stage - STAGE_FADD];
+		unit.erase(find(unit.begin(), unit.end(), seq));
+	} else {
+		latches[stage] = NO_SLOT;
+	}
+}
+
+Pipeline::Pipeline() : slots(16), mask(15), head(0), tail(0)
+{
+	for (int stage = 0; stage < NUM_STAGES; ++stage) {
+		latches[stage] = NO_SLOT;
+	}
+}
+
+long Pipeline::fetch(const Instruction &instruction)
+{
+	if (tail - head == (long)slots.size()) {
+		// ring is full, double it and re-place instructions still in flight
+		vector<Instruction> grown(slots.size() * 2);
+		for (long seq = head; seq < tail; ++seq) {
+			grown[seq & (grown.size() - 1)] = slots[seq & mask];
+		}
+		slots.swap(grown);
+		mask = slots.size() - 1;
+	}
+	slots[tail & mask] = instruction;
+	slots[tail & mask].stage = STAGE_IF;
+	latches[STAGE_IF] = tail;
+	return tail++;
+}
+
+void Pipeline::advance(long seq, int stage)
+{
+	Instruction &instruction = slots[seq & mask];
+	leave(seq, instruction.stage);
+	if (stage == STAGE_ID) {
+		decoding.push_back(seq);
+	} else if (isUnit(stage)) {
+		// units take instructions in program order
+		units[stage - STAGE_FADD].push_back(seq);
+	} else {
+		latches[stage] = seq;
+	}
+	instruction.stage = stage;
+}
+
+void Pipeline::retire(long seq)
+{
+	Instruction &instruction = slots[seq & mask];
+	leave(seq, instruction.stage);
+	if (instruction.producing) {
+		// take it off the scoreboard
+		if (instruction.younger_producer != NO_SLOT) {
+			slots[instruction.younger_producer & mask].older_producer = 
+				instruction.older_producer;
+		} else {
+			producers[(uint16_t)(instruction.destination_register + 1)] = 
+				instruction.older_producer;
+		}
+		if (instruction.older_producer != NO_SLOT) {
+			slots[instruction.older_producer & mask].younger_producer = 
+				instruction.younger_producer;
+		}
+	}
+	instruction.stage = STAGE_NONE;
+	// free the slots of retired instructions at the old end of the ring
+	while (head != tail && slots[head & mask].stage == STAGE_NONE) {
+		++head;
+	}
+}
+
+void Pipeline::unstall()
+{
+	// only instructions in ID are ever stalled
+	for (size_t i = 0; i < decoding.size(); ++i) {
+		slots[decoding[i] & mask].stalled = false;
+	}
+}
+
+long Pipeline::waitingFor(int stage)
+{
+	for (size_t i = 0; i < decoding.size(); ++i) {
+		if (stage == STAGE_EX || 
+		unitStage(slots[decoding[i] & mask].opcode) == stage) {
+			return decoding[i];
+		}
+	}
+	return NO_SLOT;
+}
+
+void Pipeline::produce(long seq)
+{
+	Instruction &instruction = slots[seq & mask];
+	size_t reg = (uint16_t)(instruction.destination_register + 1);
+	if (reg >= producers.size()) {
+		producers.resize(reg + 1, NO_SLOT);
+	}
+	instruction.producing = true;
+	instruction.older_producer = producers[reg];
+	instruction.younger_producer = NO_SLOT;
+	if (producers[reg] != NO_SLOT) {
+		slots[producers[reg] & mask].younger_producer = seq;
+	}
+	producers[reg] = seq;
+}
+
+long Pipeline::producer(uint16_t reg, int kind)
+{
+	size_t index = (uint16_t)(reg + 1);
+	long seq = index < producers.size() ? producers[index] : NO_SLOT;
+	while (seq != NO_SLOT && ((kind == PRODUCER_LOAD && 
+	!isLoad(slots[seq & mask].opcode)) || (kind == PRODUCER_NOT_LOAD && 
+	isLoad(slots[seq & mask].opcode)))) {
+		seq = slots[seq & mask].older_producer;
+	}
+	return seq;
+}
+
+void Pipeline::save(CheckpointWriter &out) const
+{
+	out.putInt(head);
+	out.putInt(tail);
+	for (int stage = 0; stage < NUM_STAGES; ++stage) {
+		out.putInt(latches[stage]);
+	}
+	out.putInt(decoding.size());
+	for (size_t i = 0; i < decoding.size(); ++i) {
+		out.putInt(decoding[i]);
+	}
+	out.putInt(producers.size());
+	for (size_t reg = 0; reg < producers.size(); ++reg) {
+		out.putInt(producers[reg]);
+	}
+	for (long seq = head; seq < tail; ++seq) {
+		const Instruction &instruction = slots[seq & mask];
+		out.putInt(instruction.opcode);
+		out.putInt(instruction.flags);
+		out.putInt(instruction.destination_register);
+		out.putInt(instruction.source_register1);
+		out.putInt(instruction.source_register2);
+		out.putInt(instruction.stage);
+		out.putInt(instruction.stalled);
+		out.putInt(instruction.result_squashed);
+		out.putInt(instruction.cycles_needed);
+		out.putInt(instruction.cycles_completed);
+		out.putInt(instruction.id);
+		out.putInt(instruction.producing);
+		// the links are only set while producing
+		out.putInt(instruction.producing ? instruction.older_producer : 
+			NO_SLOT);
+		out.putInt(instruction.producing ? instruction.younger_producer : 
+			NO_SLOT);
+	}
+}
+
+void Pipeline::load(CheckpointReader &in)
+{
+	size_t size = 16;
+	size_t count;
+
+	// sequence numbers are checked against the instructions in flight so 
+	// that a damaged checkpoint cannot index outside the ring
+	head = in.getInt(0, INT64_MAX);
+	tail = in.getInt(head, head + (1L << 30));
+	for (int stage = 0; stage < NUM_STAGES; ++stage) {
+		latches[stage] = in.getInt(NO_SLOT, tail - 1);
+	}
+	count = in.getInt(0, tail - head);
+	decoding.resize(count);
+	for (size_t i = 0; i < count; ++i) {
+		decoding[i] = in.getInt(head, tail - 1);
+	}
+	count = in.getInt(0, UINT16_MAX + 1);
+	producers.resize(count);
+	for (size_t reg = 0; reg < count; ++reg) {
+		producers[reg] = in.getInt(NO_SLOT, tail - 1);
+	}
+	while (size < (size_t)(tail - head)) {
+		size *= 2;
+	}
+	slots.clear();
+	slots.resize(size);
+	mask = size - 1;
+	for (long seq = head; seq < tail; ++seq) {
+		Instruction &instruction = slots[seq & mask];
+		instruction.opcode = in.getInt(0, opcode_count - 1);
+		instruction.flags = in.getInt(0, FLAG_FP_DEST | FLAG_TAKEN);
+		instruction.destination_register = in.getInt(0, UINT16_MAX);
+		instruction.source_register1 = in.getInt(0, UINT16_MAX);
+		instruction.source_register2 = in.getInt(0, UINT16_MAX);
+		instruction.stage = in.getInt(STAGE_NONE, NUM_STAGES - 1);
+		instruction.stalled = in.getInt(0, 1);
+		instruction.result_squashed = in.getInt(0, 1);
+		instruction.cycles_needed = in.getInt(INT32_MIN, INT32_MAX);
+		instruction.cycles_completed = in.getInt(INT32_MIN, INT32_MAX);
+		instruction.id = in.getInt(INT32_MIN, INT32_MAX);
+		instruction.producing = in.getInt(0, 1);
+		instruction.older_producer = in.getInt(NO_SLOT, tail - 1);
+		instruction.younger_producer = in.getInt(NO_SLOT, tail - 1);
+	}
+	// the FP units hold the instructions that are in them, oldest first
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		units[unit].clear();
+	}
+	for (long seq = head; seq < tail; ++seq) {
+		if (isUnit(slots[seq & mask].stage)) {
+			units[slots[seq & mask].stage - STAGE_FADD].push_back(seq);
+		}
+	}
+}
+
+void Pipeline::fingerprint(vector<long> &out) const
+{
+	// sequence number relative to the oldest instruction
+	auto relative = [this](long seq) { 
+		return seq == NO_SLOT ? NO_SLOT : seq - head; 
+	};
+
+	out.push_back(tail - head);
+	for (int stage = 0; stage < NUM_STAGES; ++stage) {
+		out.push_back(relative(latches[stage]));
+	}
+	out.push_back(decoding.size());
+	for (size_t i = 0; i < decoding.size(); ++i) {
+		out.push_back(relative(decoding[i]));
+	}
+	// the scoreboard follows from the producing instructions and their links, 
+	// and the lists of the FP units from the stages of the instructions
+	for (long seq = head; seq < tail; ++seq) {
+		const Instruction &instruction = slots[seq & mask];
+		out.push_back(instruction.stage);
+		if (instruction.stage == STAGE_NONE) {
+			// retired, nothing else about it matters
+			continue;
+		}
+		out.push_back(instruction.opcode | instruction.flags << 8 | 
+			instruction.stalled << 16 | instruction.result_squashed << 17 | 
+			instruction.producing << 18);
+		out.push_back(instruction.destination_register | 
+			(long)instruction.source_register1 << 16 | 
+			(long)instruction.source_register2 << 32);
+		out.push_back(instruction.cycles_needed);
+		out.push_back(instruction.cycles_completed);
+		if (instruction.producing) {
+			out.push_back(relative(instruction.older_producer));
+			out.push_back(relative(instruction.younger_producer));
+		}
+	}
+}
+
+void Pipeline::renumber(long offset)
+{
+	vector<Instruction> moved(slots.size());
+	auto shift = [offset](long &seq) {
+		if (seq != NO_SLOT) {
+			seq += offset;
+		}
+	};
+
+	for (long seq = head; seq < tail; ++seq) {
+		Instruction &instruction = moved[(seq + offset) & mask];
+		instruction = slots[seq & mask];
+		instruction.id += offset;
+		if (instruction.producing) {
+			shift(instruction.older_producer);
+			shift(instruction.younger_producer);
+		}
+	}
+	slots.swap(moved);
+	head += offset;
+	tail += offset;
+	for (int stage = 0; stage < NUM_STAGES; ++stage) {
+		shift(latches[stage]);
+	}
+	for (size_t i = 0; i < decoding.size(); ++i) {
+		shift(decoding[i]);
+	}
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		for (size_t i = 0; i < units[unit].size(); ++i) {
+			shift(units[unit][i]);
+		}
+	}
+	for (size_t reg = 0; reg < producers.size(); ++reg) {
+		shift(producers[reg]);
+	}
+}
@@ -0,0 +1,135 @@
+// in-flight instructions and the stage latches and scoreboard over them
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "isa.h"
+
+#include <vector>
+
+class CheckpointWriter;
+class CheckpointReader;
+
+class Instruction {
+public:
+	Instruction() {}
+	Instruction(const DecodedInstruction &decoded, int cycles, int i)
+	{
+		opcode = decoded.opcode;
+		flags = decoded.flags;
+		destination_register = decoded.destination_register;
+		source_register1 = decoded.source_register1;
+		source_register2 = decoded.source_register2;
+		stage = STAGE_NONE;
+		cycles_needed = cycles;
+		cycles_completed = 0;
+		id = i;
+		stalled = false;
+		result_squashed = false;
+		producing = false;
+	}
+	uint8_t opcode;
+	// FLAG_FP_DEST and FLAG_TAKEN
+	uint8_t flags;
+	uint16_t destination_register;
+	uint16_t source_register1;
+	uint16_t source_register2;
+	// current pipeline stage
+	uint8_t stage;
+	// is/is not stalled due to hazard
+	bool stalled;
+	// result has/has not been squashed to WAW
+	bool result_squashed;
+	// needed execution cycles
+	int cycles_needed;
+	// completed execution cycles
+	int cycles_completed;
+	// instruction number
+	int id;
+	// is/is not on the scoreboard as producer of its destination register
+	bool producing;
+	// next older and younger in-flight producers of the same register
+	long older_producer;
+	long younger_producer;
+};
+
+// sequence number of an empty latch
+const long NO_SLOT = -1;
+
+// producers of a register looked up on the scoreboard
+enum {
+	PRODUCER_ANY, PRODUCER_LOAD, PRODUCER_NOT_LOAD
+};
+
+// instructions in flight, kept in program order in a ring of reusable slots,
+// and the latch of each stage (a list for FP units) so that a stage finds 
+// its occupants without searching; instructions are referred to by their 
+// sequence number
+//
+// the pipeline also keeps the scoreboard used by the ID stage: for each 
+// register, the in-flight instructions that write it (youngest first, linked
+// through their slots), so a hazard check is a lookup rather than a scan of 
+// older instructions
+class Pipeline {
+public:
+	Pipeline();
+	Instruction &operator[](long seq) { return slots[seq & mask]; }
+	// place a newly fetched instruction in IF, returns its sequence number
+	long fetch(const Instruction&);
+	// move an instruction into another stage
+	void advance(long seq, int stage);
+	// remove an instruction from whatever stage it is in
+	void retire(long seq);
+	// clear the stalled flag of every instruction
+	void unstall();
+	bool empty() const { return head == tail; }
+	// sequence number of the oldest instruction still in flight
+	long oldest() const { return head; }
+	// instruction in IF, EX or MEM (NO_SLOT if none)
+	long occupant(int stage) const { return latches[stage]; }
+	// instructions in FADD, FMUL or FDIV, oldest first
+	const std::vector<long> &executing(int unit) const 
+	{ 
+		return units[unit - STAGE_FADD];
+	}
+	// oldest instruction in ID that executes in the given stage next
+	long waitingFor(int stage);
+	// youngest instruction in ID (NO_SLOT if none)
+	long decoded() const 
+	{ 
+		return decoding.empty() ? NO_SLOT : decoding.back();
+	}
+	// put an instruction that passed ID on the scoreboard
+	void produce(long seq);
+	// youngest in-flight producer of reg of the given kind (NO_SLOT if none)
+	long producer(uint16_t reg, int kind);
+	// write the instructions in flight, the latches and the scoreboard
+	void save(CheckpointWriter&) const;
+	// replace the whole pipeline with one written by save
+	void load(CheckpointReader&);
+	// append the state of the instructions in flight to a fingerprint, with 
+	// sequence numbers relative to the oldest so that the same state later 
+	// in the trace gives the same fingerprint
+	void fingerprint(std::vector<long>&) const;
+	// renumber the instructions in flight as if offset more instructions 
+	// had been fetched before them
+	void renumber(long offset);
+private:
+	void leave(long seq, int stage);
+	std::vector<Instruction> slots;
+	size_t mask;
+	// sequence numbers of the oldest instruction and of the next fetch
+	long head;
+	long tail;
+	long latches[NUM_STAGES];
+	// FP units can hold several instructions each
+	std::vector<long> units[NUM_FP_UNITS];
+	// ID normally holds one instruction, but an instruction left stalled 
+	// with no stall cycles pending keeps its place while later ones are 
+	// decoded behind it
+	std::vector<long> decoding;
+	// youngest producer of each register, indexed by register + 1 so that
+	// instructions missing an operand (NO_REG) also match each other
+	std::vector<long> producers;
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "profile.h"
+#include "timeline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+using namespace std;
+
+// stall cycles an entry stalled for plus those it caused
+static long stallCycles(const long stalled[NUM_HAZARDS], 
+	const long caused[NUM_HAZARDS])
+{
+	long total = 0;
+
+	for (int type = HAZARD_LOAD_DELAY; type <= HAZARD_DATA; ++type) {
+		total += stalled[type] + caused[type];
+	}
+	return total;
+}
+
+HazardProfile::Entry &HazardProfile::entry(const Instruction &instruction)
+{
+	uint64_t key = (uint64_t)instruction.opcode | 
+		(uint64_t)instruction.flags << 8 | 
+		(uint64_t)instruction.destination_register << 16 | 
+		(uint64_t)instruction.source_register1 << 32 | 
+		(uint64_t)instruction.source_register2 << 48;
+	return entries[key];
+}
+
+void HazardProfile::hazard(const HazardRecord &record)
+{
+	entry(*record.instruction).stalled[record.type] += record.cycles;
+	entry(*record.culprit).caused[record.type] += record.cycles;
+}
+
+// entries with their text, worst first
+void HazardProfile::sorted(vector<pair<string, const Entry*> > &out) const
+{
+	for (auto it = entries.begin(); it != entries.end(); ++it) {
+		DecodedInstruction decoded;
+		decoded.opcode = it->first & 0xff;
+		decoded.flags = it->first >> 8 & 0xff;
+		decoded.destination_register = it->first >> 16 & 0xffff;
+		decoded.source_register1 = it->first >> 32 & 0xffff;
+		decoded.source_register2 = it->first >> 48 & 0xffff;
+		out.push_back(make_pair(formatInstruction(decoded, registers), 
+			&it->second));
+	}
+	sort(out.begin(), out.end(), [](const pair<string, const Entry*> &a, 
+		const pair<string, const Entry*> &b) {
+		long cost_a = stallCycles(a.second->stalled, a.second->caused);
+		long cost_b = stallCycles(b.second->stalled, b.second->caused);
+		if (cost_a != cost_b) {
+			return cost_a > cost_b;
+		}
+		// then by squashes and flushes, then by text for a stable order
+		cost_a = a.second->stalled[HAZARD_WAW] + a.second->caused[HAZARD_WAW] + 
+			a.second->stalled[HAZARD_FLUSH] + a.second->caused[HAZARD_FLUSH];
+		cost_b = b.second->stalled[HAZARD_WAW] + b.second->caused[HAZARD_WAW] + 
+			b.second->stalled[HAZARD_FLUSH] + b.second->caused[HAZARD_FLUSH];
+		if (cost_a != cost_b) {
+			return cost_a > cost_b;
+		}
+		return a.first < b.first;
+	});
+}
+
+void HazardProfile::printHotSpots(size_t count) const
+{
+	vector<pair<string, const Entry*> > hot;
+	char cell[32];
+
+	sorted(hot);
+	printf("\n%-22s %9s %9s", "hot spot", "stalled", "caused");
+	for (int type = 0; type < NUM_HAZARDS; ++type) {
+		printf(" %15s", hazard_names[type]);
+	}
+	printf("\n");
+	for (size_t i = 0; i < hot.size() && i < count; ++i) {
+		const Entry &entry = *hot[i].second;
+		long stalled = 0;
+		long caused = 0;
+		for (int type = HAZARD_LOAD_DELAY; type <= HAZARD_DATA; ++type) {
+			stalled += entry.stalled[type];
+			caused += entry.caused[type];
+		}
+		printf("%-22s %9ld %9ld", hot[i].first.c_str(), stalled, caused);
+		// stalled/caused for each type
+		for (int type = 0; type < NUM_HAZARDS; ++type) {
+			snprintf(cell, sizeof(cell), "%ld/%ld", entry.stalled[type], 
+				entry.caused[type]);
+			printf(" %15s", cell);
+		}
+		printf("\n");
+	}
+}
+
+void HazardProfile::writeCsv(const char *filename) const
+{
+	vector<pair<string, const Entry*> > hot;
+	// too big for the stack
+	unique_ptr<BufferedWriter> writer(new BufferedWriter(filename));
+	BufferedWriter &out = *writer;
+
+	sorted(hot);
+	out.write("instruction", 11);
+	for (int type = 0; type < NUM_HAZARDS; ++type) {
+		for (const char *role : {"_stalled", "_caused"}) {
+			out.put(',');
+			out.write(hazard_names[type], strlen(hazard_names[type]));
+			out.write(role, strlen(role));
+		}
+	}
+	out.put('\n');
+	for (size_t i = 0; i < hot.size(); ++i) {
+		// instructions contain commas
+		out.put('"');
+		out.write(hot[i].first.data(), hot[i].first.size());
+		out.put('"');
+		for (int type = 0; type < NUM_HAZARDS; ++type) {
+			out.put(',');
+			out.putInt(hot[i].second->stalled[type]);
+			out.put(',');
+			out.putInt(hot[i].second->caused[type]);
+		}
+		out.put('\n');
+	}
+	out.close();
+}
@@ -0,0 +1,40 @@
+// hazard costs per instruction, to find the instructions worth tuning
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "simulator.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// charges every hazard both to the instruction that pays for it and to the 
+// culprit; traces carry no addresses, so instructions are told apart by 
+// opcode and registers and every dynamic instance of the same static 
+// instruction adds to one entry
+class HazardProfile : public EventSink {
+public:
+	HazardProfile(const RegisterTable &regs) : registers(regs) {}
+	void hazard(const HazardRecord&);
+	bool wantsCycles() const { return false; }
+	// print the instructions with the most stall cycles stalled for or 
+	// caused, at most count of them
+	void printHotSpots(size_t count) const;
+	// write every instruction as CSV, in the order of printHotSpots
+	void writeCsv(const char *filename) const;
+private:
+	struct Entry {
+		Entry() : stalled(), caused() {}
+		// cycles, or squashes and flushes, by hazard type
+		long stalled[NUM_HAZARDS];
+		long caused[NUM_HAZARDS];
+	};
+	Entry &entry(const Instruction&);
+	void sorted(std::vector<std::pair<std::string, const Entry*> >&) const;
+	const RegisterTable &registers;
+	// by the static instruction packed into 64 bits
+	std::unordered_map<uint64_t, Entry> entries;
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+using namespace std;
+
+const char *const sampled_names[NUM_SAMPLED] = {
+	"cycles", "load-delay", "structural", "data", "WAW squashes", 
+	"branch flushes"
+};
+
+// the statistics of a run that are sampled, in sampled_names order
+static void getSampled(const RunStats &stats, long values[NUM_SAMPLED])
+{
+	values[SAMPLE_CYCLES] = stats.cycles;
+	values[SAMPLE_LOAD_DELAY] = stats.load_delay_hazard_cycles;
+	values[SAMPLE_STRUCTURAL] = stats.structural_hazard_cycles;
+	values[SAMPLE_DATA] = stats.data_hazard_cycles;
+	values[SAMPLE_WAW] = stats.waw_squashes;
+	values[SAMPLE_FLUSHES] = stats.branch_flushes;
+}
+
+void sampleTrace(InstructionSource &source, const SimulatorConfig &config, 
+	const SamplingConfig &sampling, SampleEstimate &estimate)
+{
+	SimulatorConfig detailed = config;
+	vector<DecodedInstruction> window(sampling.warmup + sampling.window);
+	long gap = sampling.interval - (long)window.size();
+	// sums of the per-instruction rates of the windows and of their squares
+	double sum[NUM_SAMPLED] = {};
+	double squares[NUM_SAMPLED] = {};
+	long start[NUM_SAMPLED];
+	long end[NUM_SAMPLED];
+	size_t fetched;
+
+	setUnattended(detailed);
+	estimate.instructions = 0;
+	estimate.samples = 0;
+	estimate.dropped = 0;
+	for (;;) {
+		estimate.instructions += source.skip(gap);
+		for (fetched = 0; fetched < window.size() && 
+		source.next(window[fetched]);) {
+			if (fetched == 0 && isBranch(window[0].opcode) && 
+			(window[0].flags & FLAG_TAKEN)) {
+				// a taken branch with nothing in flight ahead of it empties 
+				// the pipeline as soon as it leaves ID, so the warm-up starts 
+				// at the instruction after it instead
+				++estimate.instructions;
+			} else {
+				++fetched;
+			}
+		}
+		estimate.instructions += fetched;
+		if (fetched < window.size()) {
+			// too little of the trace is left for another window
+			break;
+		}
+
+		RecordSource records(window.data(), window.size());
+		Simulator simulator(detailed, records);
+		RunStats before = simulator.stats();
+		try {
+			// the window's instructions are fetched in the cycles after the 
+			// one that fetched the last warm-up instruction, up to the one 
+			// that fetches its own last instruction
+			while (simulator.stats().instructions < (long)window.size() && 
+			simulator.step()) {
+				if (simulator.stats().instructions <= sampling.warmup) {
+					before = simulator.stats();
+				}
+			}
+		} catch (const SimulationError &error) {
+			throw SimulationError("window at instruction " + 
+				to_string(estimate.instructions - sampling.window + 1) + 
+				": " + error.what());
+		}
+		if (simulator.stats().instructions < (long)window.size()) {
+			// the pipeline still ran empty after a taken branch, with fewer 
+			// instructions in flight than the full simulation would have 
+			// there; nothing to measure
+			++estimate.dropped;
+			continue;
+		}
+		getSampled(before, start);
+		getSampled(simulator.stats(), end);
+		for (int q = 0; q < NUM_SAMPLED; ++q) {
+			double rate = (double)(end[q] - start[q]) / sampling.window;
+			sum[q] += rate;
+			squares[q] += rate * rate;
+		}
+		++estimate.samples;
+	}
+	if (estimate.samples == 0 && estimate.dropped) {
+		throw SimulationError("the pipeline ran empty in every window");
+	} else if (estimate.samples == 0) {
+		throw SimulationError("trace too short for a single window");
+	}
+	for (int q = 0; q < NUM_SAMPLED; ++q) {
+		double mean = sum[q] / estimate.samples;
+		estimate.total[q] = mean * estimate.instructions;
+		estimate.error[q] = -1;
+		if (estimate.samples > 1) {
+			// normal approximation of the mean over the windows
+			double variance = (squares[q] - sum[q] * mean) / 
+				(estimate.samples - 1);
+			estimate.error[q] = 1.96 * sqrt(max(variance, 0.0) / 
+				estimate.samples) * estimate.instructions;
+		}
+	}
+}
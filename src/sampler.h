@@ -0,0 +1,56 @@
+// sampled simulation in the style of SMARTS: the trace is cut into periods 
+// of a fixed number of instructions, most of each period is only decoded and 
+// skipped, and its last instructions run through the detailed simulator, 
+// first to warm the pipeline up and then as a measured window; totals for 
+// the whole trace are extrapolated from the per-instruction means of the 
+// windows
+//
+// the pipeline keeps no state that outlives the instructions in flight (no 
+// caches or predictors), so the functional warming that SMARTS does between 
+// windows reduces to the detailed warm-up: once the producers of the 
+// instructions just before a window are back in flight, the pipeline is in 
+// the state the full simulation would have it in
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "simulator.h"
+
+struct SamplingConfig {
+	SamplingConfig() : interval(100000), window(1000), warmup(100) {}
+	// instructions from the start of one window to the start of the next
+	long interval;
+	// instructions measured in each window
+	long window;
+	// instructions simulated in detail but not measured before each window, 
+	// enough for the longest FP latency to drain
+	long warmup;
+};
+
+// quantities estimated by sampling
+enum {
+	SAMPLE_CYCLES, SAMPLE_LOAD_DELAY, SAMPLE_STRUCTURAL, SAMPLE_DATA, 
+	SAMPLE_WAW, SAMPLE_FLUSHES, NUM_SAMPLED
+};
+
+extern const char *const sampled_names[NUM_SAMPLED];
+
+struct SampleEstimate {
+	// instructions in the whole trace
+	long instructions;
+	// windows measured
+	long samples;
+	// windows left out because the pipeline ran empty before their end
+	long dropped;
+	// estimated totals over the whole trace
+	double total[NUM_SAMPLED];
+	// half width of the 95% confidence interval of each total, negative 
+	// with fewer than two windows
+	double error[NUM_SAMPLED];
+};
+
+// estimate the statistics of a whole trace from windows of it; throws 
+// SimulationError if a window deadlocks or none can be measured
+void sampleTrace(InstructionSource &source, const SimulatorConfig &config, 
+	const SamplingConfig &sampling, SampleEstimate &estimate);
+
+#endif
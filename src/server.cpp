@@ -0,0 +1,302 @@
+#include "server.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+using namespace std;
+
+SimulationServer::SimulationServer(const SimulatorConfig &config, int count) 
+	: defaults(config), threads(count), listener(-1), stopping(false)
+{
+}
+
+void SimulationServer::serve(const char *path)
+{
+	struct sockaddr_un address;
+	struct stat st;
+	vector<thread> pool;
+	int client;
+	int probe;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		throw SimulationError(string("socket path too long: ") + path);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+	// a socket left behind by a server that is gone is replaced, a live 
+	// one or anything that is not a socket is left alone
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode) && 
+		(probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0) {
+		if (connect(probe, (struct sockaddr*) &address, 
+			sizeof(address)) != 0 && errno == ECONNREFUSED) {
+			unlink(path);
+		}
+		close(probe);
+	}
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (listener < 0) {
+		throw SimulationError(string("could not create socket: ") + 
+			strerror(errno));
+	}
+	if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 || 
+		listen(listener, SOMAXCONN) != 0) {
+		string message = string("could not listen on ") + path + ": " + 
+			strerror(errno);
+		close(listener);
+		throw SimulationError(message);
+	}
+	for (int i = 0; i < threads; ++i) {
+		pool.push_back(thread(&SimulationServer::work, this));
+	}
+	// a shutdown request shuts the listening socket down, which ends accept
+	while ((client = accept4(listener, NULL, NULL, SOCK_CLOEXEC)) >= 0 || 
+		errno == EINTR || errno == ECONNABORTED) {
+		if (client < 0) {
+			continue;
+		}
+		{
+			lock_guard<mutex> guard(lock);
+			clients.push_back(client);
+		}
+		ready.notify_one();
+	}
+	{
+		// clients still waiting are turned away, and those being served 
+		// stop after the job they are running
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+		for (size_t i = 0; i < active.size(); ++i) {
+			::shutdown(active[i], SHUT_RD);
+		}
+	}
+	ready.notify_all();
+	for (size_t i = 0; i < pool.size(); ++i) {
+		pool[i].join();
+	}
+	close(listener);
+	unlink(path);
+}
+
+void SimulationServer::work()
+{
+	Arena arena;
+	int client;
+
+	arena.input.resize(1 << 16);
+	for (;;) {
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [this] { return stopping || !clients.empty(); });
+			if (clients.empty()) {
+				return;
+			}
+			client = clients.front();
+			clients.pop_front();
+			if (stopping) {
+				close(client);
+				continue;
+			}
+			active.push_back(client);
+		}
+		converse(client, arena);
+		{
+			lock_guard<mutex> guard(lock);
+			active.erase(find(active.begin(), active.end(), client));
+			close(client);
+		}
+	}
+}
+
+// answer the jobs of one client until it hangs up
+void SimulationServer::converse(int client, Arena &arena)
+{
+	string_view request;
+
+	arena.begin = arena.end = 0;
+	while (readLine(client, arena, request) && runJob(request, client, arena)) {
+	}
+}
+
+// next line from the client without its line break, false once the client 
+// has hung up
+bool SimulationServer::readLine(int client, Arena &arena, string_view &line)
+{
+	char *start;
+	char *newline;
+	ssize_t count;
+
+	for (;;) {
+		start = arena.input.data() + arena.begin;
+		newline = static_cast<char*>(memchr(start, '\n', 
+			arena.end - arena.begin));
+		if (newline) {
+			line = string_view(start, newline - start);
+			if (!line.empty() && line.back() == '\r') {
+				line.remove_suffix(1);
+			}
+			arena.begin = newline + 1 - arena.input.data();
+			return true;
+		}
+		// move the partial line to the front and read more behind it
+		memmove(arena.input.data(), start, arena.end - arena.begin);
+		arena.end -= arena.begin;
+		arena.begin = 0;
+		if (arena.end == arena.input.size()) {
+			arena.input.resize(arena.input.size() * 2);
+		}
+		do {
+			count = recv(client, arena.input.data() + arena.end, 
+				arena.input.size() - arena.end, 0);
+		} while (count < 0 && errno == EINTR);
+		if (count <= 0) {
+			return false;
+		}
+		arena.end += count;
+	}
+}
+
+// run one job and send its answer, false if the client is gone or asked 
+// for a shutdown
+bool SimulationServer::runJob(string_view request, int client, Arena &arena)
+{
+	static const struct {
+		const char *name;
+		int SimulatorConfig::*latency;
+	} settings[] = {
+		{"fp_add_sub", &SimulatorConfig::fp_add_sub},
+		{"fp_mul", &SimulatorConfig::fp_mul},
+		{"fp_div", &SimulatorConfig::fp_div}
+	};
+	SimulatorConfig config = defaults;
+	vector<string_view> words;
+	string error;
+	string_view line;
+	size_t at = 0;
+	size_t next;
+	char text[256];
+
+	// split the request into words
+	while (at < request.size()) {
+		next = min(request.find(' ', at), request.size());
+		if (next > at) {
+			words.push_back(request.substr(at, next - at));
+		}
+		at = next + 1;
+	}
+	if (words.empty()) {
+		return true;
+	}
+	for (size_t w = words[0] == "run" ? 2 : 1; w < words.size(); ++w) {
+		size_t eq = words[w].find('=');
+		string value(words[w].substr(eq == string_view::npos ? 
+			words[w].size() : eq + 1));
+		char *end;
+		long latency = strtol(value.c_str(), &end, 10);
+		size_t s;
+
+		for (s = 0; s < sizeof(settings) / sizeof(settings[0]); ++s) {
+			if (words[w].substr(0, eq) == settings[s].name) {
+				break;
+			}
+		}
+		if (s == sizeof(settings) / sizeof(settings[0]) || eq == 
+			string_view::npos || *end != '\0' || end == value.c_str() || 
+			latency < 1 || latency > INT_MAX) {
+			error = "invalid setting " + string(words[w]);
+			break;
+		}
+		config.*settings[s].latency = latency;
+	}
+
+	arena.answer.clear();
+	if (words[0] == "trace") {
+		// take in the whole trace even if the job cannot run, so that the 
+		// next request is read from the right place
+		arena.text.clear();
+		for (;;) {
+			if (!readLine(client, arena, line)) {
+				return false;
+			}
+			if (line == ".") {
+				break;
+			}
+			arena.text.insert(arena.text.end(), line.begin(), line.end());
+			arena.text.push_back('\n');
+		}
+	} else if (words[0] == "shutdown") {
+		::shutdown(listener, SHUT_RDWR);
+		arena.answer = "ok\n";
+	} else if (words[0] != "run" || words.size() < 2) {
+		error = "unknown request " + string(request);
+	}
+	if (error.empty() && arena.answer.empty()) {
+		try {
+			RegisterTable registers;
+			TraceReader in;
+			BinaryTrace binary;
+			RunStats stats;
+
+			if (words[0] == "trace") {
+				in.assign(arena.text.data(), arena.text.size());
+				arena.records.clear();
+				getInstructions(arena.records, registers, in, false, 0);
+				RecordSource source(arena.records.data(), arena.records.size());
+				Simulator simulator(config, source);
+				simulator.run();
+				stats = simulator.stats();
+			} else if (binary.open(string(words[1]).c_str(), registers)) {
+				RecordSource source(binary.records(), binary.size());
+				Simulator simulator(config, source);
+				simulator.run();
+				stats = simulator.stats();
+			} else if (!in.open(string(words[1]).c_str())) {
+				throw SimulationError("could not open trace file " + 
+					string(words[1]));
+			} else {
+				// the window lets -l find loops in the stream
+				StreamSource stream(in, registers);
+				WindowSource source(stream);
+				Simulator simulator(config, source);
+				simulator.run();
+				stats = simulator.stats();
+			}
+			snprintf(text, sizeof(text), "ok cycles=%ld instructions=%ld " 
+				"retired=%ld load-delay=%ld structural=%ld data=%ld WAW=%ld "
+				"flushes=%ld\n", stats.cycles, stats.instructions, 
+				stats.retired, stats.load_delay_hazard_cycles, 
+				stats.structural_hazard_cycles, stats.data_hazard_cycles, 
+				stats.waw_squashes, stats.branch_flushes);
+			arena.answer = text;
+		} catch (const SimulationError &failure) {
+			error = failure.what();
+		}
+	}
+	if (!error.empty()) {
+		// the answer has to stay on one line
+		replace(error.begin(), error.end(), '\n', ' ');
+		arena.answer = "error " + error + "\n";
+	}
+	for (at = 0; at < arena.answer.size(); at += next) {
+		ssize_t sent = send(client, arena.answer.data() + at, 
+			arena.answer.size() - at, MSG_NOSIGNAL);
+		if (sent < 0 && errno == EINTR) {
+			next = 0;
+			continue;
+		}
+		if (sent <= 0) {
+			return false;
+		}
+		next = sent;
+	}
+	return words[0] != "shutdown";
+}
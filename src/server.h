@@ -0,0 +1,66 @@
+// resident simulator answering jobs over a Unix domain socket, so that many 
+// small runs do not each pay for starting a process and reading config.txt
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "simulator.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the protocol is line based; a client sends any number of jobs and gets 
+// one line back for each, in order:
+//
+//	run PATH [name=value ...]	a text or binary trace file
+//	trace [name=value ...]		the trace follows, up to a line "."
+//	shutdown			stop once running jobs are answered
+//
+// where name is fp_add_sub, fp_mul or fp_div and overrides that latency 
+// for the job; the answer is either
+//
+//	ok cycles=N instructions=N retired=N load-delay=N structural=N data=N
+//	WAW=N flushes=N
+//
+// on one line, or "error MESSAGE"
+class SimulationServer {
+public:
+	// jobs run with config unless they override its latencies
+	SimulationServer(const SimulatorConfig &config, int threads);
+	// listen on path, which must not exist unless it is a stale socket, and 
+	// answer clients until one asks for a shutdown; throws if the socket 
+	// cannot be set up
+	void serve(const char *path);
+private:
+	// buffers of one thread, reused by all of its jobs so that once they 
+	// have grown to the size of the traces a job allocates little
+	struct Arena {
+		// received and not yet consumed from begin to end
+		std::vector<char> input;
+		size_t begin;
+		size_t end;
+		// an inline trace and its decoded records
+		std::vector<char> text;
+		std::vector<DecodedInstruction> records;
+		std::string answer;
+	};
+	void work();
+	void converse(int client, Arena&);
+	bool readLine(int client, Arena&, std::string_view &line);
+	bool runJob(std::string_view request, int client, Arena&);
+	SimulatorConfig defaults;
+	int threads;
+	int listener;
+	// accepted connections waiting for a thread and those being served, 
+	// guarded by lock
+	std::deque<int> clients;
+	std::vector<int> active;
+	bool stopping;
+	std::mutex lock;
+	std::condition_variable ready;
+};
+
+#endif
@@ -0,0 +1,880 @@
+#include "simulator.h"
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+using namespace std;
+
+const char *const column_names[NUM_COLUMNS] = {
+	"IF", "ID", "EX", "MEM", "WB", "FADD", "FMUL", "FDIV", "FWB"
+};
+
+const char *const hazard_names[NUM_HAZARDS] = {
+	"load-delay", "structural", "data", "WAW", "flush"
+};
+
+// upcoming cycles in which nothing happens other than FP units executing and
+// stall cycles passing, or NEVER if the pipeline can no longer change at all
+const long NEVER = -1;
+
+static long idleCycles(Pipeline &pipeline, const FpUnitConfig *units, 
+	bool fetching, int current_stall_cycle, int needed_stall_cycles)
+{
+	long idle = NEVER;
+	long i;
+
+	if (pipeline.occupant(STAGE_MEM) != NO_SLOT || 
+	pipeline.occupant(STAGE_EX) != NO_SLOT) {
+		return 0;
+	}
+	i = pipeline.waitingFor(STAGE_EX);
+	if (i != NO_SLOT && !pipeline[i].stalled) {
+		return 0;
+	}
+	if (current_stall_cycle != needed_stall_cycles) {
+		// the last stall cycle unstalls the waiting instruction
+		if (needed_stall_cycles > current_stall_cycle) {
+			idle = needed_stall_cycles - current_stall_cycle - 1;
+		}
+	} else if (fetching) {
+		// next cycle decodes or fetches
+		return 0;
+	}
+	for (int unit = STAGE_FADD; unit <= STAGE_FDIV; ++unit) {
+		const FpUnitConfig &config = units[unit - STAGE_FADD];
+		const vector<long> &executing = pipeline.executing(unit);
+		// copies that cannot take an instruction yet, and the fewest cycles 
+		// until a pipelined one can
+		int busy = 0;
+		long ready = NEVER;
+
+		for (size_t k = 0; k < executing.size(); ++k) {
+			i = executing[k];
+			if (pipeline[i].cycles_completed < pipeline[i].cycles_needed) {
+				// the cycle that completes the instruction is simulated, it 
+				// writes back (or is squashed) right after
+				if (idle == NEVER || pipeline[i].cycles_needed - 
+				pipeline[i].cycles_completed - 1 < idle) {
+					idle = pipeline[i].cycles_needed - 
+						pipeline[i].cycles_completed - 1;
+				}
+			} else if (pipeline[i].cycles_completed == 
+			pipeline[i].cycles_needed) {
+				// waiting for FWB
+				return 0;
+			}
+			if (!config.pipelined) {
+				++busy;
+			} else if (pipeline[i].cycles_completed < config.interval) {
+				++busy;
+				if (ready == NEVER || 
+				config.interval - pipeline[i].cycles_completed < ready) {
+					ready = config.interval - pipeline[i].cycles_completed;
+				}
+			}
+		}
+		i = pipeline.waitingFor(unit);
+		if (i != NO_SLOT && !pipeline[i].stalled) {
+			if (busy < config.count) {
+				return 0;
+			}
+			// the cycle a pipelined copy takes it is simulated
+			if (ready != NEVER && (idle == NEVER || ready < idle)) {
+				idle = ready;
+			}
+		}
+	}
+	return idle;
+}
+
+// FNV-1a over whole instructions
+const uint64_t FIRST_TRACE_HASH = 0xcbf29ce484222325;
+
+static uint64_t traceHash(uint64_t hash, const DecodedInstruction &instruction)
+{
+	uint64_t word;
+
+	memcpy(&word, &instruction, sizeof(word));
+	return (hash ^ word) * 0x100000001b3;
+}
+
+int opcodeLatency(const SimulatorConfig &config, int opcode)
+{
+	// unless the opcode table says otherwise, FP arithmetic takes the 
+	// latency of its unit and everything else a single execution cycle
+	if (opcodes[opcode].latency) {
+		return opcodes[opcode].latency;
+	} else if (opcodes[opcode].unit == STAGE_FADD) {
+		return config.fp_add_sub;
+	} else if (opcodes[opcode].unit == STAGE_FMUL) {
+		return config.fp_mul;
+	} else if (opcodes[opcode].unit == STAGE_FDIV) {
+		return config.fp_div;
+	}
+	return 1;
+}
+
+void setUnattended(SimulatorConfig &config)
+{
+	// fast-forwarding gives the same statistics, and a run that deadlocks 
+	// throws instead of holding its thread, and everything waiting on it, 
+	// forever
+	config.fast_forward = true;
+}
+
+Simulator::Simulator(const SimulatorConfig &config, 
+	InstructionSource &instructions) : source(instructions), 
+	fast_forward(config.fast_forward), 
+	extrapolate_loops(config.extrapolate_loops), 
+	trace_hash(FIRST_TRACE_HASH), current_cycle(0), 
+	current_stall_cycle(0), needed_stall_cycles(0), branch_taken(false), 
+	last_instruction_fetched(false), started(false), finished(false), 
+	recording(false), retired_limit(LONG_MAX), fetched_limit(LONG_MAX)
+{
+	configure(config);
+}
+
+Simulator::Simulator(const Simulator &from, const SimulatorConfig &config, 
+	InstructionSource &instructions) : source(instructions), 
+	fast_forward(config.fast_forward), 
+	extrapolate_loops(config.extrapolate_loops), 
+	boundaries(from.boundaries), pipeline(from.pipeline), 
+	counters(from.counters), trace_hash(from.trace_hash), 
+	current_cycle(from.current_cycle), 
+	current_stall_cycle(from.current_stall_cycle), 
+	needed_stall_cycles(from.needed_stall_cycles), 
+	branch_taken(from.branch_taken), taken_branch(from.taken_branch), 
+	last_instruction_fetched(from.last_instruction_fetched), 
+	started(from.started), finished(from.finished), recording(false), 
+	retired_limit(LONG_MAX), fetched_limit(LONG_MAX)
+{
+	configure(config);
+}
+
+void Simulator::configure(const SimulatorConfig &config)
+{
+	results_wait = false;
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		units[unit] = config.units[unit];
+		if (units[unit].count > 1 || units[unit].pipelined) {
+			results_wait = true;
+		}
+	}
+	for (int op = 0; op < opcode_count; ++op) {
+		latencies[op] = opcodeLatency(config, op);
+	}
+}
+
+bool Simulator::step()
+{
+	if (!finished) {
+		simulate(current_cycle + 1);
+	}
+	return !finished;
+}
+
+bool Simulator::run(long cycles)
+{
+	retired_limit = LONG_MAX;
+	fetched_limit = LONG_MAX;
+	return runUntil(cycles < 0 ? LONG_MAX : current_cycle + cycles);
+}
+
+bool Simulator::runRetired(long count, long cycles)
+{
+	retired_limit = counters.retired + count;
+	fetched_limit = LONG_MAX;
+	return runUntil(cycles < 0 ? LONG_MAX : current_cycle + cycles);
+}
+
+bool Simulator::runFetched(long count, long cycles)
+{
+	retired_limit = LONG_MAX;
+	fetched_limit = count;
+	return runUntil(cycles < 0 ? LONG_MAX : current_cycle + cycles);
+}
+
+// simulate up to cycle limit, retired_limit or fetched_limit
+bool Simulator::runUntil(long limit)
+{
+	// idle cycles jumped over by fast-forward retire and fetch nothing, so 
+	// the retired limit is never overshot by more than one cycle's worth, 
+	// and the fetched limit not at all
+	while (!finished && current_cycle < limit && 
+	counters.retired < retired_limit && 
+	counters.instructions < fetched_limit) {
+		simulate(limit);
+	}
+	return !finished;
+}
+
+void Simulator::save(const char *filename) const
+{
+	CheckpointWriter out;
+
+	out.putInt(opcode_count);
+	for (int op = 0; op < opcode_count; ++op) {
+		out.putInt(latencies[op]);
+	}
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		out.putInt(units[unit].count);
+		out.putInt(units[unit].pipelined);
+		out.putInt(units[unit].interval);
+	}
+	out.putInt(counters.cycles);
+	out.putInt(counters.instructions);
+	out.putInt(trace_hash);
+	out.putInt(counters.load_delay_hazard_cycles);
+	out.putInt(counters.structural_hazard_cycles);
+	out.putInt(counters.data_hazard_cycles);
+	out.putInt(counters.waw_squashes);
+	out.putInt(counters.branch_flushes);
+	out.putInt(counters.retired);
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		out.putInt(counters.fp_busy_cycles[unit]);
+	}
+	out.putInt(current_cycle);
+	out.putInt(current_stall_cycle);
+	out.putInt(needed_stall_cycles);
+	out.putInt(branch_taken);
+	out.putInt(last_instruction_fetched);
+	out.putInt(finished);
+	pipeline.save(out);
+	out.save(filename);
+}
+
+void Simulator::restore(const char *filename)
+{
+	CheckpointReader in(filename);
+	DecodedInstruction instruction;
+	uint64_t hash;
+
+	if (started) {
+		throw SimulationError("cannot restore a checkpoint once started");
+	}
+	if (in.getInt() != opcode_count) {
+		throw SimulationError("checkpoint was taken with other opcodes");
+	}
+	for (int op = 0; op < opcode_count; ++op) {
+		if (in.getInt() != latencies[op]) {
+			throw SimulationError("checkpoint was taken with other latencies");
+		}
+	}
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		if (in.getInt() != units[unit].count || 
+		in.getInt() != units[unit].pipelined || 
+		in.getInt() != units[unit].interval) {
+			throw SimulationError("checkpoint was taken with other FP units");
+		}
+	}
+	counters.cycles = in.getInt(0, LONG_MAX);
+	counters.instructions = in.getInt(0, INT_MAX);
+	hash = in.getInt();
+	counters.load_delay_hazard_cycles = in.getInt(LONG_MIN, LONG_MAX);
+	counters.structural_hazard_cycles = in.getInt(LONG_MIN, LONG_MAX);
+	counters.data_hazard_cycles = in.getInt(LONG_MIN, LONG_MAX);
+	counters.waw_squashes = in.getInt(0, LONG_MAX);
+	counters.branch_flushes = in.getInt(0, LONG_MAX);
+	counters.retired = in.getInt(0, LONG_MAX);
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		counters.fp_busy_cycles[unit] = in.getInt(0, LONG_MAX);
+	}
+	current_cycle = in.getInt(0, LONG_MAX);
+	current_stall_cycle = in.getInt(INT_MIN, INT_MAX);
+	needed_stall_cycles = in.getInt(INT_MIN, INT_MAX);
+	branch_taken = in.getInt(0, 1);
+	last_instruction_fetched = in.getInt(0, 1);
+	finished = in.getInt(0, 1);
+	pipeline.load(in);
+	in.finish();
+	// every instruction fetched so far is in the pipeline or gone through it
+	for (long n = 0; n < counters.instructions; ++n) {
+		if (!source.next(instruction)) {
+			throw SimulationError("trace ends before the checkpoint");
+		}
+		trace_hash = traceHash(trace_hash, instruction);
+	}
+	if (trace_hash != hash) {
+		throw SimulationError("checkpoint was taken on another trace");
+	}
+}
+
+// most boundaries remembered at once
+const size_t MAX_BOUNDARIES = 4096;
+
+// if the state left by this cycle was also left by an earlier one at the end 
+// of a taken branch, and the instructions fetched since then repeat in the 
+// trace, every repetition takes the same cycles and adds the same counts; 
+// jump over as many as there are, without going past cycle limit
+void Simulator::extrapolate(long limit)
+{
+	size_t count;
+	size_t position;
+	const DecodedInstruction *trace = source.records(count, position);
+	long period;
+	long cycles;
+	long most;
+	long k;
+
+	if (!trace) {
+		return;
+	}
+	fingerprint.clear();
+	fingerprint.push_back(current_stall_cycle);
+	fingerprint.push_back(needed_stall_cycles);
+	fingerprint.push_back(branch_taken | last_instruction_fetched << 1);
+	pipeline.fingerprint(fingerprint);
+	string key((const char *)fingerprint.data(), 
+		fingerprint.size() * sizeof(fingerprint[0]));
+	auto found = boundaries.find(key);
+	if (found == boundaries.end()) {
+		if (boundaries.size() == MAX_BOUNDARIES) {
+			// not looping, or over a body too long to be worth finding
+			boundaries.clear();
+		}
+		boundaries.emplace(key, counters);
+		return;
+	}
+	RunStats before = found->second;
+	found->second = counters;
+	period = counters.instructions - before.instructions;
+	cycles = counters.cycles - before.cycles;
+	if (period <= 0 || position >= count || (size_t)period > position) {
+		// (or the window holds too little of the earlier iteration)
+		return;
+	}
+	// the trace has to go on past the last repetition, so that whether it 
+	// is exhausted is answered as it was in the earlier iteration
+	most = min((long)(count - position - 1) / period, 
+		(limit - current_cycle) / cycles);
+	if (counters.retired > before.retired) {
+		most = min(most, (retired_limit - counters.retired) / 
+			(counters.retired - before.retired));
+	}
+	most = min(most, (fetched_limit - counters.instructions) / period);
+	for (k = 0; k < most && memcmp(trace + position + k * period, 
+	trace + position - period, period * sizeof(DecodedInstruction)) == 0; 
+	++k) {
+	}
+	if (k == 0) {
+		return;
+	}
+	current_cycle += k * cycles;
+	counters.cycles = current_cycle;
+	counters.instructions += k * period;
+	counters.load_delay_hazard_cycles += k * 
+		(counters.load_delay_hazard_cycles - before.load_delay_hazard_cycles);
+	counters.structural_hazard_cycles += k * 
+		(counters.structural_hazard_cycles - before.structural_hazard_cycles);
+	counters.data_hazard_cycles += k * 
+		(counters.data_hazard_cycles - before.data_hazard_cycles);
+	counters.waw_squashes += k * (counters.waw_squashes - before.waw_squashes);
+	counters.branch_flushes += k * 
+		(counters.branch_flushes - before.branch_flushes);
+	counters.retired += k * (counters.retired - before.retired);
+	for (int unit = 0; unit < NUM_FP_UNITS; ++unit) {
+		counters.fp_busy_cycles[unit] += k * (counters.fp_busy_cycles[unit] - 
+			before.fp_busy_cycles[unit]);
+	}
+	pipeline.renumber(k * period);
+	for (long n = 0; n < k * period; ++n) {
+		trace_hash = traceHash(trace_hash, trace[position + n]);
+	}
+	source.skip(k * period);
+	// remembered counters are from before the jump
+	boundaries.clear();
+}
+
+// copies of an FP unit that can take an instruction this cycle
+int Simulator::freeCopies(int unit)
+{
+	const FpUnitConfig &config = units[unit - STAGE_FADD];
+	const vector<long> &executing = pipeline.executing(unit);
+	int busy = 0;
+
+	for (size_t k = 0; k < executing.size(); ++k) {
+		if (!config.pipelined || 
+		pipeline[executing[k]].cycles_completed < config.interval) {
+			++busy;
+		}
+	}
+	return config.count - busy;
+}
+
+// instruction the FWB stage writes back at the start of the next cycle, the 
+// oldest finished one (NO_SLOT if none)
+long Simulator::writeback()
+{
+	long seq = NO_SLOT;
+	long j;
+
+	for (int unit = STAGE_FADD; unit <= STAGE_FDIV; ++unit) {
+		const vector<long> &executing = pipeline.executing(unit);
+		for (size_t k = 0; k < executing.size(); ++k) {
+			j = executing[k];
+			if (pipeline[j].cycles_completed == pipeline[j].cycles_needed && 
+			(seq == NO_SLOT || j < seq)) {
+				seq = j;
+			}
+		}
+	}
+	j = pipeline.occupant(STAGE_MEM);
+	if (j != NO_SLOT && writesBackAfterMem(pipeline[j].opcode) && 
+	(seq == NO_SLOT || j < seq)) {
+		seq = j;
+	}
+	return seq;
+}
+
+// cycles until the executing instruction seq frees its copy of the unit
+long Simulator::busyFor(long seq)
+{
+	const Instruction &instruction = pipeline[seq];
+	const FpUnitConfig &config = units[instruction.stage - STAGE_FADD];
+
+	if (results_wait && 
+	instruction.cycles_completed == instruction.cycles_needed && 
+	(!config.pipelined || instruction.cycles_completed < config.interval)) {
+		// a result waiting for FWB keeps its copy until it wins the 
+		// arbitration, which is known only for the next cycle
+		return writeback() == seq ? 0 : 1;
+	}
+	if (config.pipelined) {
+		return config.interval - instruction.cycles_completed;
+	}
+	return instruction.cycles_needed - instruction.cycles_completed;
+}
+
+// executing instruction that frees a copy of the unit first if all of them 
+// are busy, NO_SLOT if one is free or about to be
+long Simulator::structuralCulprit(int unit)
+{
+	const FpUnitConfig &config = units[unit - STAGE_FADD];
+	const vector<long> &executing = pipeline.executing(unit);
+	long culprit = NO_SLOT;
+	int busy = 0;
+
+	for (size_t k = 0; k < executing.size(); ++k) {
+		if (config.pipelined && busyFor(executing[k]) <= 0) {
+			continue;
+		}
+		++busy;
+		if (culprit == NO_SLOT || 
+		busyFor(executing[k]) < busyFor(culprit)) {
+			culprit = executing[k];
+		}
+	}
+	if (busy < config.count || busyFor(culprit) == 0) {
+		return NO_SLOT;
+	}
+	return culprit;
+}
+
+// report a hazard to every sink
+void Simulator::hazard(int type, long cycles, const Instruction &instruction, 
+	const Instruction &culprit)
+{
+	HazardRecord record = { type, cycles, &instruction, &culprit };
+
+	for (size_t i = 0; i < sinks.size(); ++i) {
+		sinks[i]->hazard(record);
+	}
+}
+
+// hand a finished row to every sink
+void Simulator::record(const CycleRecord &row)
+{
+	for (size_t i = 0; i < sinks.size(); ++i) {
+		sinks[i]->cycle(row);
+	}
+}
+
+// simulate the next cycle, fast-forwarding to it first if enabled, without 
+// going past cycle limit
+void Simulator::simulate(long limit)
+{
+	// what each stage did in the current cycle
+	CycleRecord row;
+	// cycles jumped over in fast-forward mode
+	long skip;
+	long flushes;
+	long i;
+	int unit;
+
+	if (!started) {
+		for (i = 0; i < (long)sinks.size(); ++i) {
+			sinks[i]->begin();
+		}
+		started = true;
+	}
+	if (fast_forward && !pipeline.empty()) {
+		// jump to the cycle before the next change of pipeline state
+		skip = idleCycles(pipeline, units, !source.empty() || 
+			pipeline.occupant(STAGE_IF) != NO_SLOT, current_stall_cycle, 
+			needed_stall_cycles);
+		if (skip == NEVER) {
+			char message[64];
+			snprintf(message, sizeof(message), 
+				"pipeline deadlocked at cycle %ld", current_cycle);
+			throw SimulationError(message);
+		}
+		if (skip > limit - current_cycle - 1) {
+			// run and step stop at the limit
+			skip = limit - current_cycle - 1;
+		}
+		if (!recording) {
+			// nobody needs the rows of the skipped cycles
+			current_cycle += skip;
+			if (current_stall_cycle != needed_stall_cycles) {
+				current_stall_cycle += skip;
+			}
+			for (unit = STAGE_FADD; unit <= STAGE_FDIV; ++unit) {
+				const vector<long> &executing = pipeline.executing(unit);
+				for (size_t k = 0; k < executing.size(); ++k) {
+					pipeline[executing[k]].cycles_completed += skip;
+				}
+				if (!executing.empty()) {
+					counters.fp_busy_cycles[unit - STAGE_FADD] += skip;
+				}
+			}
+			skip = 0;
+		}
+		for (; skip > 0; --skip) {
+			row.cycle = ++current_cycle;
+			memset(row.ids, 0, sizeof(row.ids));
+			// executing FP units each complete another cycle, a unit shows 
+			// the oldest of its instructions
+			for (unit = STAGE_FDIV; unit >= STAGE_FADD; --unit) {
+				const vector<long> &executing = pipeline.executing(unit);
+				for (size_t k = 0; k < executing.size(); ++k) {
+					pipeline[executing[k]].cycles_completed++;
+				}
+				if (!executing.empty()) {
+					row.ids[COL_FADD + unit - STAGE_FADD] = 
+						pipeline[executing[0]].id;
+					++counters.fp_busy_cycles[unit - STAGE_FADD];
+				}
+			}
+			if (current_stall_cycle != needed_stall_cycles) {
+				++current_stall_cycle;
+				row.ids[COL_ID] = STALLED;
+				if (!last_instruction_fetched) {
+					row.ids[COL_IF] = STALLED;
+				}
+			}
+			record(row);
+		}
+	}
+	row.cycle = ++current_cycle;
+	memset(row.ids, 0, sizeof(row.ids));
+	flushes = counters.branch_flushes;
+	stages(row);
+	// timeline output is skipped entirely without sinks that want it
+	if (recording) {
+		record(row);
+	}
+	counters.cycles = current_cycle;
+	if (extrapolate_loops && sinks.empty() && 
+	counters.branch_flushes != flushes) {
+		// a taken branch just went through ID, likely the end of a loop body
+		extrapolate(limit);
+	}
+	if (pipeline.empty()) {
+		finished = true;
+		for (i = 0; i < (long)sinks.size(); ++i) {
+			sinks[i]->end();
+		}
+	}
+}
+
+// work of each stage in the current cycle, back to front
+void Simulator::stages(CycleRecord &row)
+{
+	// holds the instruction fetched in the IF stage
+	DecodedInstruction fetched;
+	// sequence numbers of pipeline instructions
+	long i;
+	long j;
+	// hazard culprits found on the scoreboard
+	long structural;
+	long load;
+	long data;
+	long culprit;
+	int kind;
+	int unit;
+	// free copies of an FP unit
+	int copies;
+
+	// FWB stage
+	// if an ADD.S, SUB.S, MUL.S, or DIV.S instruction has completed its 
+	// required cycles, or if MTC1, CVT.S.W, CVT.W.S, MOV.S, or L.S has 
+	// completed the MEM stage, write back the result of the oldest one
+	i = writeback();
+	if (i != NO_SLOT) {
+		row.ids[COL_FWB] = pipeline[i].id;
+		// remove from pipeline
+		pipeline.retire(i);
+		++counters.retired;
+	}
+	// FDIV, FMUL and FADD stages
+	for (unit = STAGE_FDIV; unit >= STAGE_FADD; --unit) {
+		const vector<long> &executing = pipeline.executing(unit);
+		bool busy = false;
+
+		// free copies of the unit take the oldest instructions waiting for 
+		// it in ID (if they are not stalled)
+		for (copies = freeCopies(unit); copies > 0; --copies) {
+			i = pipeline.waitingFor(unit);
+			if (i == NO_SLOT || pipeline[i].stalled) {
+				break;
+			}
+			pipeline.advance(i, unit);
+		}
+		for (size_t k = 0; k < executing.size(); ) {
+			i = executing[k];
+			if (pipeline[i].stalled || (results_wait && 
+			pipeline[i].cycles_completed == pipeline[i].cycles_needed)) {
+				// stalled, or done and waiting for FWB
+				++k;
+				continue;
+			}
+			// instruction executes another cycle, the unit shows the oldest 
+			// one that does
+			if (!busy) {
+				row.ids[COL_FADD + unit - STAGE_FADD] = pipeline[i].id;
+				++counters.fp_busy_cycles[unit - STAGE_FADD];
+				busy = true;
+			}
+			pipeline[i].cycles_completed++;
+			if (pipeline[i].cycles_completed == pipeline[i].cycles_needed && 
+			pipeline[i].result_squashed) {
+				// if instruction has completed, but result has been squashed, 
+				// remove instuction from pipeline (do not want to write back)
+				pipeline.retire(i);
+				++counters.retired;
+				continue;
+			}
+			++k;
+		}
+	}
+	// WB stage
+	i = pipeline.occupant(STAGE_MEM);
+	if (i != NO_SLOT && !pipeline[i].stalled) {
+		// instruction completed, write back result
+		row.ids[COL_WB] = pipeline[i].id;
+		// remove from pipeline
+		pipeline.retire(i);
+		++counters.retired;
+	}
+	// MEM stage
+	i = pipeline.occupant(STAGE_EX);
+	if (i != NO_SLOT && !pipeline[i].stalled) {
+		// transition instruction from EX stage to MEM
+		pipeline.advance(i, STAGE_MEM);
+		row.ids[COL_MEM] = pipeline[i].id;
+		if (isStore(pipeline[i].opcode)) {
+			// store instructions complete in MEM stage, remove from
+			// pipeline
+			pipeline.retire(i);
+			++counters.retired;
+		}
+	}
+	// EX stage
+	// (the original model also lets an instruction that found its FP unit 
+	// busy pass through EX, and keeps doing so to leave its results alone)
+	i = pipeline.waitingFor(STAGE_EX);
+	if (i != NO_SLOT && !pipeline[i].stalled && (!results_wait || 
+	unitStage(pipeline[i].opcode) == STAGE_NONE)) {
+		// transition instruction from ID stage to EX
+		pipeline.advance(i, STAGE_EX);
+		row.ids[COL_EX] = pipeline[i].id;
+	}
+	// execute needed stalls
+	if (current_stall_cycle != needed_stall_cycles) {
+		row.ids[COL_ID] = STALLED;
+		if (!last_instruction_fetched) {
+			// last instruction was not fetched yet, IF stalls as well
+			row.ids[COL_IF] = STALLED;
+		}
+		i = pipeline.decoded();
+		if (++current_stall_cycle == needed_stall_cycles && results_wait && 
+		i != NO_SLOT && pipeline[i].stalled && 
+		unitStage(pipeline[i].opcode) != STAGE_NONE && 
+		(j = structuralCulprit(unitStage(pipeline[i].opcode))) != NO_SLOT) {
+			// every copy of the unit is still taken, such as by results 
+			// waiting for FWB, stall until one is free
+			needed_stall_cycles += busyFor(j);
+			counters.structural_hazard_cycles += busyFor(j);
+			if (!sinks.empty()) {
+				hazard(HAZARD_STRUCTURAL, busyFor(j), pipeline[i], 
+					pipeline[j]);
+			}
+		} else if (current_stall_cycle == needed_stall_cycles) {
+			// needed stall(s) have been executed
+			// reset stall counters
+			current_stall_cycle = 0;
+			needed_stall_cycles = 0;
+			// unstall the instruction that needed the stall(s)
+			pipeline.unstall();
+		}
+		return;
+	}
+	// ID stage
+	i = pipeline.occupant(STAGE_IF);
+	if (i != NO_SLOT) {
+		// transition instruction from IF stage to ID
+		pipeline.advance(i, STAGE_ID);
+		row.ids[COL_ID] = pipeline[i].id;
+		if (source.empty()) {
+			// this is the last instruction, so any stalls will happen only
+			// in future ID stages
+			last_instruction_fetched = true;
+		}
+		// look up the hazard culprit on the scoreboard: the youngest older 
+		// instruction that is using the functional unit this instruction 
+		// needs, that is a load producing the address register of this 
+		// store, or that produces one of its source registers
+		unit = unitStage(pipeline[i].opcode);
+		structural = NO_SLOT;
+		if (unit != STAGE_NONE) {
+			structural = structuralCulprit(unit);
+		}
+		load = NO_SLOT;
+		if (isStore(pipeline[i].opcode)) {
+			load = pipeline.producer(pipeline[i].destination_register, 
+				PRODUCER_LOAD);
+			// store instruction does not write to memory until MEM stage, 
+			// at which time the value of a load instruction's destination 
+			// register will be available, so loads are not data hazards
+			kind = PRODUCER_NOT_LOAD;
+		} else {
+			kind = PRODUCER_ANY;
+		}
+		data = max(pipeline.producer(pipeline[i].source_register1, kind), 
+			pipeline.producer(pipeline[i].source_register2, kind));
+		culprit = max(structural, max(load, data));
+		// check for WAW (current instruction will write to same FP reg 
+		// before an executing instuction) against producers of the 
+		// destination register no older than the culprit
+		if (pipeline[i].flags & FLAG_FP_DEST) {
+			for (j = pipeline.producer(pipeline[i].destination_register, 
+			PRODUCER_ANY); j != NO_SLOT && j >= culprit; 
+			j = pipeline[j].older_producer) {
+				if (pipeline[i].cycles_needed < 
+				(pipeline[j].cycles_needed - pipeline[j].cycles_completed)) {
+					// squash result (prevent it from be written to FP reg)
+					pipeline[j].result_squashed = true;
+					++counters.waw_squashes;
+					if (!sinks.empty()) {
+						hazard(HAZARD_WAW, 1, pipeline[j], pipeline[i]);
+					}
+				}
+			}
+		}
+		j = culprit;
+		if (j == NO_SLOT) {
+			// no hazard
+		} else if (j == structural) {
+			// structural hazard (every copy of the required functional unit 
+			// is being used by an executing instruction), needed stall cycles
+			// is the number of cycles until the culprit frees its copy
+			needed_stall_cycles = busyFor(j);
+			if (needed_stall_cycles < 0) {
+				// if culprit instruction will complete, don't need to
+				// stall
+				needed_stall_cycles = 0;
+			} else {
+				// stall current instruction
+				pipeline[i].stalled = true;
+				counters.structural_hazard_cycles += needed_stall_cycles;
+				if (!sinks.empty()) {
+					hazard(HAZARD_STRUCTURAL, needed_stall_cycles, pipeline[i], 
+						pipeline[j]);
+				}
+			}
+		} else if (j == load || isLoad(pipeline[j].opcode)) {
+			// load hazard: instruction needs value of load instruction's 
+			// destination register to execute (or, for a store, to write 
+			// to memory), only need one stall cycle
+			needed_stall_cycles = 1;
+			counters.load_delay_hazard_cycles += needed_stall_cycles;
+			if (!sinks.empty()) {
+				hazard(HAZARD_LOAD_DELAY, needed_stall_cycles, pipeline[i], 
+					pipeline[j]);
+			}
+			// stall current instruction
+			pipeline[i].stalled = true;
+		} else {
+			// data hazard: instruction needs value of previous 
+			// instruction's destination register to execute
+			if (isBranch(pipeline[i].opcode)) {
+				// branch instructions are resolved in ID stage, so need
+				// to stall for source register value (1 cycle)
+				needed_stall_cycles = 1;
+				// stall current instruction
+				pipeline[i].stalled = true;
+			} else if (isFPArith(pipeline[j].opcode)) {
+				// needed stall cycles is the numer of cycles the
+				// culprit instruction still needs
+				needed_stall_cycles = pipeline[j].cycles_needed - 
+				pipeline[j].cycles_completed;
+				if (isStore(pipeline[i].opcode)) {
+					// needed stall cycles is one less because store 
+					// instruction doesn't write to memory until MEM 
+					// stage
+					needed_stall_cycles -= 1;
+				}
+				if ((isStore(pipeline[i].opcode) && 
+				needed_stall_cycles < 0) || 
+				(results_wait && needed_stall_cycles <= 0)) {
+					// if instruction will complete, though, don't
+					// need to stall (the original model stalls for good 
+					// on a result that completed this very cycle)
+					needed_stall_cycles = 0;
+				} else {
+					// stall current instruction
+					pipeline[i].stalled = true;
+				}
+			}
+			counters.data_hazard_cycles += needed_stall_cycles;
+			if (!sinks.empty() && needed_stall_cycles != 0) {
+				hazard(HAZARD_DATA, needed_stall_cycles, pipeline[i], 
+					pipeline[j]);
+			}
+		}
+		if (isBranch(pipeline[i].opcode)) {
+			if (pipeline[i].flags & FLAG_TAKEN) {
+				// needed to flush fetched instruction
+				branch_taken = true;
+				taken_branch = pipeline[i];
+			}
+			// branch instructions complete in ID stage, remove from pipeline
+			pipeline.retire(i);
+			++counters.retired;
+		} else {
+			// later instructions see it on the scoreboard
+			pipeline.produce(i);
+		}
+	}
+	// IF stage
+	if (source.next(fetched)) {
+		trace_hash = traceHash(trace_hash, fetched);
+		// fetch next instruction, place it in pipeline
+		i = pipeline.fetch(Instruction(fetched, latencies[fetched.opcode], 
+			++counters.instructions));
+		// record its identifier
+		row.ids[COL_IF] = pipeline[i].id;
+		// if branch is taken, need to flush fetched instruction
+		if (branch_taken) {
+			pipeline.retire(i);
+			++counters.branch_flushes;
+			if (!sinks.empty()) {
+				hazard(HAZARD_FLUSH, 1, pipeline[i], taken_branch);
+			}
+			// reset flag
+			branch_taken = false;
+		}
+	}
+}
@@ -0,0 +1,349 @@
+// cycle-by-cycle simulator of the pipeline, usable without the pipe CLI:
+//
+//	SimulatorConfig config;
+//	config.fp_mul = 5;
+//	RecordSource source(records, count);
+//	Simulator simulator(config, source);
+//	simulator.run();
+//	printf("%ld cycles\n", simulator.stats().cycles);
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include "isa.h"
+#include "pipeline.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// columns of the timeline
+enum Column {
+	COL_IF, COL_ID, COL_EX, COL_MEM, COL_WB, COL_FADD, COL_FMUL, COL_FDIV, 
+	COL_FWB, NUM_COLUMNS
+};
+
+extern const char *const column_names[NUM_COLUMNS];
+
+// timeline entry of a stage that stalled
+const int STALLED = -1;
+
+// one row of the timeline: the instruction each stage worked on during a 
+// cycle, 0 if the stage did nothing
+struct CycleRecord {
+	long cycle;
+	int ids[NUM_COLUMNS];
+};
+
+// costs charged to instructions
+enum Hazard {
+	HAZARD_LOAD_DELAY, HAZARD_STRUCTURAL, HAZARD_DATA, HAZARD_WAW, 
+	HAZARD_FLUSH, NUM_HAZARDS
+};
+
+extern const char *const hazard_names[NUM_HAZARDS];
+
+// a hazard found in ID, or a squash or flush
+struct HazardRecord {
+	int type;
+	// stall cycles, 1 for a WAW squash or a branch flush
+	long cycles;
+	// the instruction that stalls, has its result squashed or is flushed
+	const Instruction *instruction;
+	// the one responsible: the culprit found in ID, the later write of the 
+	// same register, or the taken branch
+	const Instruction *culprit;
+};
+
+// receives what the simulator does, such as the timeline one cycle at a time
+class EventSink {
+public:
+	virtual ~EventSink() {}
+	// before the first cycle
+	virtual void begin() {}
+	virtual void cycle(const CycleRecord&) {}
+	// during the cycle the hazard is found in, before that cycle is reported;
+	// summed over a run, the hazards give the hazard counters
+	virtual void hazard(const HazardRecord&) {}
+	// after the last instruction has left the pipeline
+	virtual void end() {}
+	// false for sinks that ignore cycles, which then need not be recorded
+	virtual bool wantsCycles() const { return true; }
+};
+
+// one kind of FP functional unit
+struct FpUnitConfig {
+	FpUnitConfig() : count(1), pipelined(false), interval(1) {}
+	// identical copies of the unit
+	int count;
+	// a pipelined copy takes a new instruction once the previous one has 
+	// executed interval cycles, any other copy only once its instruction has 
+	// left the unit
+	bool pipelined;
+	int interval;
+};
+
+// latencies and modes of a run
+struct SimulatorConfig {
+	SimulatorConfig() : fp_add_sub(1), fp_mul(1), fp_div(1), 
+		fast_forward(false), extrapolate_loops(false) {}
+	// execution cycles of each FP unit, for opcodes the opcode table gives 
+	// no latency of their own; everything else takes one cycle
+	int fp_add_sub;
+	int fp_mul;
+	int fp_div;
+	// FADD, FMUL and FDIV, by default a single copy of each that is not 
+	// pipelined
+	FpUnitConfig units[NUM_FP_UNITS];
+	// jump over cycles in which only stalls and FP units progress
+	bool fast_forward;
+	// jump over loop iterations that repeat an earlier one exactly, for 
+	// sources that hold the trace in memory
+	bool extrapolate_loops;
+};
+
+// execution cycles of opcode under config
+int opcodeLatency(const SimulatorConfig &config, int opcode);
+
+// set up config for a run nobody watches, one of many in a batch, sweep, 
+// sample or server
+void setUnattended(SimulatorConfig &config);
+
+// results of one run
+struct RunStats {
+	RunStats() : cycles(0), instructions(0), load_delay_hazard_cycles(0), 
+		structural_hazard_cycles(0), data_hazard_cycles(0), waw_squashes(0), 
+		branch_flushes(0), retired(0), fp_busy_cycles() {}
+	long cycles;
+	// instructions fetched, including flushed ones
+	long instructions;
+	long load_delay_hazard_cycles;
+	long structural_hazard_cycles;
+	long data_hazard_cycles;
+	long waw_squashes;
+	long branch_flushes;
+	// instructions that left the pipeline other than by being flushed
+	long retired;
+	// cycles in which any copy of each FP unit executed, FADD first
+	long fp_busy_cycles[NUM_FP_UNITS];
+};
+
+// supplies instructions to the IF stage one at a time
+class InstructionSource {
+public:
+	virtual ~InstructionSource() {}
+	// fetch next instruction, returns false if the trace is exhausted
+	virtual bool next(DecodedInstruction&) = 0;
+	// true if there are no instructions left to fetch
+	virtual bool empty() = 0;
+	// pass over up to count instructions, returns how many there were
+	virtual size_t skip(size_t count)
+	{
+		DecodedInstruction instruction;
+		size_t skipped = 0;
+		while (skipped < count && next(instruction)) {
+			++skipped;
+		}
+		return skipped;
+	}
+	// the instructions held in memory around the next one, the whole trace 
+	// or a window of it, and the index of the next one among them; NULL for 
+	// sources that hold none
+	virtual const DecodedInstruction *records(size_t &count, 
+		size_t &position)
+	{
+		return NULL;
+	}
+};
+
+// fetches from decoded instructions already in memory, either loaded up 
+// front by getInstructions or mapped from a binary trace
+class RecordSource : public InstructionSource {
+public:
+	RecordSource(const DecodedInstruction *records, size_t count) 
+		: instructions(records), size(count), ptr(0) {}
+	bool next(DecodedInstruction &instruction)
+	{
+		if (ptr == size) {
+			return false;
+		}
+		instruction = instructions[ptr++];
+		return true;
+	}
+	bool empty() { return ptr == size; }
+	size_t skip(size_t count)
+	{
+		count = std::min(count, size - ptr);
+		ptr += count;
+		return count;
+	}
+	const DecodedInstruction *records(size_t &count, size_t &position)
+	{
+		count = size;
+		position = ptr;
+		return instructions;
+	}
+private:
+	const DecodedInstruction *instructions;
+	size_t size;
+	size_t ptr;
+};
+
+// keeps a window of another source's instructions in memory, the last ones 
+// fetched and those coming up, so that loops in a stream can be 
+// extrapolated; a loop body longer than HISTORY instructions is not found
+class WindowSource : public InstructionSource {
+public:
+	WindowSource(InstructionSource &from) : source(from), ptr(0) {}
+	bool next(DecodedInstruction &instruction)
+	{
+		if (ptr == window.size() && !fill()) {
+			return false;
+		}
+		instruction = window[ptr++];
+		return true;
+	}
+	bool empty() { return ptr == window.size() && !fill(); }
+	size_t skip(size_t count)
+	{
+		size_t skipped = std::min(count, window.size() - ptr);
+
+		ptr += skipped;
+		if (skipped < count) {
+			// what is left in the window no longer comes right before the 
+			// next instruction
+			window.clear();
+			ptr = 0;
+			skipped += source.skip(count - skipped);
+		}
+		return skipped;
+	}
+	const DecodedInstruction *records(size_t &count, size_t &position)
+	{
+		// refilling only once half the read-ahead is used up keeps the 
+		// copying to a few moves per instruction
+		if (window.size() - ptr < AHEAD / 2) {
+			fill();
+		}
+		count = window.size();
+		position = ptr;
+		return window.data();
+	}
+private:
+	static const size_t HISTORY = 32768;
+	static const size_t AHEAD = 32768;
+	// drop all but the last HISTORY instructions fetched and read up to 
+	// AHEAD past the next one, false if there is no next one
+	bool fill()
+	{
+		DecodedInstruction instruction;
+		size_t keep = std::min(ptr, HISTORY);
+
+		window.erase(window.begin(), window.begin() + (ptr - keep));
+		ptr = keep;
+		while (window.size() - ptr < AHEAD && source.next(instruction)) {
+			window.push_back(instruction);
+		}
+		return ptr < window.size();
+	}
+	InstructionSource &source;
+	std::vector<DecodedInstruction> window;
+	size_t ptr;
+};
+
+// runs one trace through the pipeline; errors, such as a deadlock found 
+// while fast-forwarding, are thrown as SimulationError
+class Simulator {
+public:
+	Simulator(const SimulatorConfig &config, InstructionSource &source);
+	// carry on from the state from has reached but with the latencies of 
+	// config, reading the rest of the trace from source, which has to be 
+	// where the source of from is; every instruction from has fetched must 
+	// take the same cycles under both configurations, and then the run is 
+	// the one config would have had from the start (sinks are not copied)
+	Simulator(const Simulator &from, const SimulatorConfig &config, 
+		InstructionSource &source);
+	// report to sink from the first cycle on, it is not owned and has to be 
+	// added before the first step
+	void addSink(EventSink *sink) 
+	{ 
+		sinks.push_back(sink);
+		recording = recording || sink->wantsCycles();
+	}
+	// simulate one cycle, false once the pipeline has drained
+	bool step();
+	// simulate up to cycles more cycles, all remaining ones if cycles is 
+	// negative; false once the pipeline has drained
+	bool run(long cycles = -1);
+	// like run, but also stop after the cycle in which at least count more 
+	// instructions have retired
+	bool runRetired(long count, long cycles = -1);
+	// like run, but also stop after the cycle in which the trace's count-th 
+	// instruction (from the start) is fetched
+	bool runFetched(long count, long cycles = -1);
+	bool done() const { return finished; }
+	// counters so far, complete once done
+	const RunStats &stats() const { return counters; }
+	// write the complete state to a checkpoint file
+	void save(const char *filename) const;
+	// continue from a checkpoint instead of the first cycle; call it before 
+	// the first step, with the source at the start of the trace the 
+	// checkpoint was taken from (text or binary), which is then skipped up 
+	// to where the checkpoint was taken
+	void restore(const char *filename);
+private:
+	void configure(const SimulatorConfig &config);
+	bool runUntil(long limit);
+	void simulate(long limit);
+	void stages(CycleRecord &row);
+	void record(const CycleRecord &row);
+	void extrapolate(long limit);
+	long writeback();
+	int freeCopies(int unit);
+	long busyFor(long seq);
+	long structuralCulprit(int unit);
+	void hazard(int type, long cycles, const Instruction &instruction, 
+		const Instruction &culprit);
+	InstructionSource &source;
+	bool fast_forward;
+	bool extrapolate_loops;
+	// counters at the end of recent cycles that flushed the fetch after a 
+	// taken branch, by the fingerprint of the state the cycle left
+	std::unordered_map<std::string, RunStats> boundaries;
+	std::vector<long> fingerprint;
+	// execution cycles needed by each opcode
+	int latencies[MAX_OPCODES];
+	FpUnitConfig units[NUM_FP_UNITS];
+	// a result that loses FWB arbitration waits in its unit; the original 
+	// model of a single unpipelined copy of each unit kept counting its 
+	// cycles instead, and still does so that its results stay the same
+	bool results_wait;
+	std::vector<EventSink*> sinks;
+	// to hold instructions currently in pipeline
+	Pipeline pipeline;
+	RunStats counters;
+	// hash of every instruction fetched so far, which a checkpoint keeps so 
+	// that it is not restored against another trace
+	uint64_t trace_hash;
+	// current CPU cycle
+	long current_cycle;
+	// used to execute correct number of needed stalls
+	int current_stall_cycle;
+	int needed_stall_cycles;
+	// used to determine if next instruction needs to be flushed
+	bool branch_taken;
+	// copy of the taken branch, which has left the pipeline by the time the 
+	// instruction after it is flushed
+	Instruction taken_branch;
+	bool last_instruction_fetched;
+	bool started;
+	bool finished;
+	// some sink wants the row of every cycle
+	bool recording;
+	// run stops once this many instructions have retired or been fetched
+	long retired_limit;
+	long fetched_limit;
+};
+
+#endif
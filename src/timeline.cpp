@@ -0,0 +1,351 @@
+#include "timeline.h"
+
+#include <cstring>
+using namespace std;
+
+void TerminalTimeline::begin()
+{
+	printf("%5s %5s %5s %5s %5s %5s %5s %5s %5s %5s\n", "cycle", "IF", "ID", 
+		"EX", "MEM", "WB", "FADD", "FMUL", "FDIV", "FWB");
+	printf("----- ----- ----- ----- ----- ----- ----- ----- ----- -----\n");
+}
+
+void TerminalTimeline::cycle(const CycleRecord &row)
+{
+	// stages are printed in the order they are simulated, each one moving 
+	// the cursor to its column and back to the start of the line
+	static const int order[] = {
+		COL_FWB, COL_FDIV, COL_FMUL, COL_FADD, COL_WB, COL_MEM, COL_EX, COL_ID, 
+		COL_IF
+	};
+	int col;
+
+	for (int i = 0; i < NUM_COLUMNS; ++i) {
+		col = order[i];
+		if (row.ids[col] > 0) {
+			printf("%*d\r", 11 + 6 * col, row.ids[col]);
+		}
+	}
+	if (row.ids[COL_IF] == STALLED) {
+		printf("%5ld %5s %5s\n", row.cycle, "stall", "stall");
+	} else if (row.ids[COL_ID] == STALLED) {
+		// last instruction was fetched, only need to stall in ID stage
+		printf("%5ld %11s\n", row.cycle, "stall");
+	} else {
+		printf("%5ld\n", row.cycle);
+	}
+}
+
+BufferedWriter::BufferedWriter(const char *filename) 
+	: name(filename), used(0)
+{
+	if (name == "-") {
+		file = stdout;
+	} else if (!(file = fopen(filename, "wb"))) {
+		throw SimulationError("could not open output file " + name);
+	}
+}
+
+BufferedWriter::~BufferedWriter()
+{
+	// an error here cannot be reported any more, call close to see it
+	if (file && used) {
+		fwrite(buffer, 1, used, file);
+		fflush(file);
+	}
+	if (file && file != stdout) {
+		fclose(file);
+	}
+}
+
+void BufferedWriter::close()
+{
+	FILE *closing = file;
+
+	flush();
+	file = NULL;
+	if (closing != stdout && fclose(closing) != 0) {
+		throw SimulationError("could not write output file " + name);
+	}
+}
+
+void BufferedWriter::write(const void *data, size_t size)
+{
+	if (used + size > sizeof(buffer)) {
+		flush();
+		if (size > sizeof(buffer)) {
+			// too big to buffer
+			if (fwrite(data, 1, size, file) != size) {
+				throw SimulationError("could not write output file " + name);
+			}
+			return;
+		}
+	}
+	memcpy(buffer + used, data, size);
+	used += size;
+}
+
+void BufferedWriter::putInt(long value)
+{
+	char digits[24];
+	int n = 0;
+
+	if (value < 0) {
+		put('-');
+		value = -value;
+	}
+	do {
+		digits[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (n) {
+		put(digits[--n]);
+	}
+}
+
+void BufferedWriter::flush()
+{
+	size_t count = used;
+
+	// the buffer is given up even if it cannot be written, so that the 
+	// destructor does not try again
+	used = 0;
+	if ((count && fwrite(buffer, 1, count, file) != count) || 
+		fflush(file) != 0) {
+		throw SimulationError("could not write output file " + name);
+	}
+}
+
+void CsvTimeline::begin()
+{
+	out.write("cycle", 5);
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		out.put(',');
+		out.write(column_names[col], strlen(column_names[col]));
+	}
+	out.put('\n');
+}
+
+void CsvTimeline::cycle(const CycleRecord &row)
+{
+	out.putInt(row.cycle);
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		out.put(',');
+		if (row.ids[col] == STALLED) {
+			out.write("stall", 5);
+		} else if (row.ids[col]) {
+			out.putInt(row.ids[col]);
+		}
+	}
+	out.put('\n');
+}
+
+void BinaryTimeline::begin()
+{
+	out.write("PIPETL01", 8);
+}
+
+void BinaryTimeline::cycle(const CycleRecord &row)
+{
+	int32_t record[1 + NUM_COLUMNS];
+
+	record[0] = row.cycle;
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		record[1 + col] = row.ids[col];
+	}
+	out.write(record, sizeof(record));
+}
+
+ChromeTimeline::ChromeTimeline(const char *filename) 
+	: out(filename), finished(false), last_cycle(-1)
+{
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		open_id[col] = 0;
+		open_since[col] = 0;
+	}
+	batch.reserve(BATCH_ROWS);
+	writer = thread(&ChromeTimeline::write, this);
+}
+
+ChromeTimeline::~ChromeTimeline()
+{
+	// a write error not collected by end is lost
+	try {
+		finish();
+	} catch (const SimulationError&) {
+	}
+}
+
+// queue the filled batch for the writer, waiting while it is behind; once 
+// the writer has failed, rows are dropped
+void ChromeTimeline::submit()
+{
+	unique_lock<mutex> guard(lock);
+
+	room.wait(guard, [this] { 
+		return queue.size() < MAX_QUEUED || !error.empty();
+	});
+	if (!error.empty()) {
+		batch.clear();
+		return;
+	}
+	queue.push_back(vector<CycleRecord>());
+	queue.back().swap(batch);
+	if (!spare.empty()) {
+		batch.swap(spare.back());
+		spare.pop_back();
+	} else {
+		batch.reserve(BATCH_ROWS);
+	}
+	guard.unlock();
+	ready.notify_one();
+}
+
+// hand over the last rows and wait for the writer to close the trace, then 
+// throw the error the writer met, if any; a run cut short by an error still 
+// leaves a file that can be read
+void ChromeTimeline::finish()
+{
+	string failure;
+
+	if (!writer.joinable()) {
+		return;
+	}
+	if (!batch.empty()) {
+		submit();
+	}
+	{
+		lock_guard<mutex> guard(lock);
+		finished = true;
+	}
+	ready.notify_one();
+	writer.join();
+	failure.swap(error);
+	if (!failure.empty()) {
+		throw SimulationError(failure);
+	}
+}
+
+// writer thread: an error ends it, and is kept for finish to throw on the 
+// simulator's thread
+void ChromeTimeline::write()
+{
+	try {
+		writeEvents();
+	} catch (const SimulationError &failure) {
+		lock_guard<mutex> guard(lock);
+		error = failure.what();
+	}
+	// the simulator may be waiting for room
+	room.notify_one();
+}
+
+void ChromeTimeline::writeEvents()
+{
+	vector<vector<CycleRecord>> work;
+	char text[256];
+	bool done;
+
+	out.write("{\"traceEvents\":[", 16);
+	// name the stage threads and keep them in pipeline order
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		snprintf(text, sizeof(text), "%s\n{\"name\":\"thread_name\",\"ph\":\"M\","
+			"\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n"
+			"{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,"
+			"\"tid\":%d,\"args\":{\"sort_index\":%d}}", col ? "," : "", col, 
+			column_names[col], col, col);
+		out.write(text, strlen(text));
+	}
+	do {
+		{
+			unique_lock<mutex> guard(lock);
+			ready.wait(guard, [this] { return finished || !queue.empty(); });
+			work.swap(queue);
+			done = finished && work.empty();
+		}
+		room.notify_one();
+		for (size_t b = 0; b < work.size(); ++b) {
+			for (size_t r = 0; r < work[b].size(); ++r) {
+				advance(work[b][r]);
+			}
+			work[b].clear();
+		}
+		if (!work.empty()) {
+			lock_guard<mutex> guard(lock);
+			for (size_t b = 0; b < work.size(); ++b) {
+				spare.push_back(vector<CycleRecord>());
+				spare.back().swap(work[b]);
+			}
+		}
+		work.clear();
+	} while (!done);
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		event(col, last_cycle + 1);
+	}
+	out.write("\n]}\n", 4);
+	out.close();
+}
+
+// end the events of stages whose entry changed and start new ones
+void ChromeTimeline::advance(const CycleRecord &row)
+{
+	bool gap = row.cycle != last_cycle + 1;
+
+	for (int col = 0; col < NUM_COLUMNS; ++col) {
+		if (row.ids[col] != open_id[col] || gap) {
+			event(col, last_cycle + 1);
+			open_id[col] = row.ids[col];
+			open_since[col] = row.cycle;
+		}
+	}
+	last_cycle = row.cycle;
+}
+
+// append the decimal digits of a non-negative value
+static char *digits(char *at, long value)
+{
+	char reversed[24];
+	int n = 0;
+
+	do {
+		reversed[n++] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	while (n) {
+		*at++ = reversed[--n];
+	}
+	return at;
+}
+
+// write the open event of a stage, if any, as ending before cycle end
+void ChromeTimeline::event(int col, long end)
+{
+	static const char head[] = ",\n{\"name\":\"";
+	static const char stall[] = "stall";
+	static const char fields[] = "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+	char text[128];
+	char *at = text;
+
+	if (open_id[col] == 0) {
+		return;
+	}
+	memcpy(at, head, sizeof(head) - 1);
+	at += sizeof(head) - 1;
+	if (open_id[col] == STALLED) {
+		memcpy(at, stall, sizeof(stall) - 1);
+		at += sizeof(stall) - 1;
+	} else {
+		at = digits(at, open_id[col]);
+	}
+	memcpy(at, fields, sizeof(fields) - 1);
+	at += sizeof(fields) - 1;
+	// stages are numbered by single digits
+	*at++ = '0' + col;
+	memcpy(at, ",\"ts\":", 6);
+	at = digits(at + 6, open_since[col]);
+	memcpy(at, ",\"dur\":", 7);
+	at = digits(at + 7, end - open_since[col]);
+	*at++ = '}';
+	out.write(text, at - text);
+	open_id[col] = 0;
+}
@@ -0,0 +1,121 @@
+// timeline sinks: the terminal table, CSV and binary files and Chrome traces
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include "simulator.h"
+
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// prints the timeline as a table on stdout
+class TerminalTimeline : public EventSink {
+public:
+	void begin();
+	void cycle(const CycleRecord&);
+};
+
+// collects output in a large buffer so that it reaches the file in a few 
+// big writes; errors are thrown as SimulationError, except from the 
+// destructor, so close the writer to be sure everything reached the file
+class BufferedWriter {
+public:
+	// "-" writes to stdout
+	BufferedWriter(const char *filename);
+	~BufferedWriter();
+	void write(const void *data, size_t size);
+	void put(char c)
+	{
+		if (used == sizeof(buffer)) {
+			flush();
+		}
+		buffer[used++] = c;
+	}
+	void putInt(long value);
+	void flush();
+	// flush and close the file, nothing can be written afterwards
+	void close();
+private:
+	std::string name;
+	FILE *file;
+	size_t used;
+	char buffer[1 << 20];
+};
+
+// writes the timeline as CSV, one line per cycle
+class CsvTimeline : public EventSink {
+public:
+	CsvTimeline(const char *filename) : out(filename) {}
+	void begin();
+	void cycle(const CycleRecord&);
+	void end() { out.close(); }
+private:
+	BufferedWriter out;
+};
+
+// writes the timeline as fixed-width binary records: after an 8 byte magic 
+// number, each cycle is the cycle number followed by the column entries, all 
+// as 32-bit integers in host byte order
+class BinaryTimeline : public EventSink {
+public:
+	BinaryTimeline(const char *filename) : out(filename) {}
+	void begin();
+	void cycle(const CycleRecord&);
+	void end() { out.close(); }
+private:
+	BufferedWriter out;
+};
+
+// writes the timeline in the Chrome trace event format read by Perfetto and 
+// chrome://tracing: each stage is a thread, and each stretch of cycles an 
+// instruction spends in a stage is a complete event, one microsecond per 
+// cycle; rows are handed in batches to a writer thread that turns them 
+// into JSON, so the simulator only copies them, and an error writing the 
+// file is thrown by end
+class ChromeTimeline : public EventSink {
+public:
+	ChromeTimeline(const char *filename);
+	~ChromeTimeline();
+	void cycle(const CycleRecord &row)
+	{
+		batch.push_back(row);
+		if (batch.size() == BATCH_ROWS) {
+			submit();
+		}
+	}
+	void end() { finish(); }
+private:
+	static const size_t BATCH_ROWS = 4096;
+	// batches queued before the simulator waits for the writer
+	static const size_t MAX_QUEUED = 16;
+	void submit();
+	void finish();
+	// writer thread
+	void write();
+	void writeEvents();
+	void advance(const CycleRecord&);
+	void event(int col, long end);
+	BufferedWriter out;
+	std::vector<CycleRecord> batch;
+	// filled batches waiting for the writer and emptied ones to reuse, 
+	// guarded by lock
+	std::vector<std::vector<CycleRecord>> queue;
+	std::vector<std::vector<CycleRecord>> spare;
+	std::mutex lock;
+	std::condition_variable ready;
+	std::condition_variable room;
+	bool finished;
+	// what went wrong on the writer thread, empty if nothing did
+	std::string error;
+	std::thread writer;
+	// used only by the writer: the entry each stage has shown since when, 
+	// and the last cycle seen
+	int open_id[NUM_COLUMNS];
+	long open_since[NUM_COLUMNS];
+	long last_cycle;
+};
+
+#endif
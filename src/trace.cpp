@@ -0,0 +1,638 @@
+#include "trace.h"
+#include "timeline.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// binary trace, written by convertTrace: an 8 byte magic number, one 
+// DecodedInstruction per instruction, the register names (a 16-bit length 
+// followed by the characters each), the opcode table the records index (the 
+// format in a byte, then the mnemonic like a register name) and a trailer 
+// holding the instruction count, the offsets of the names and of the 
+// opcodes and the magic number again; all integers are in host byte order
+struct BinaryTraceTrailer {
+	uint64_t count;
+	uint64_t names_offset;
+	uint64_t opcodes_offset;
+	char magic[8];
+};
+
+// the last two characters are the version of the layout
+static const char binary_trace_magic[8] = {
+	'P', 'I', 'P', 'E', 'T', 'R', '0', '2'
+};
+
+MappedFile::~MappedFile()
+{
+	if (base) {
+		munmap(base, length);
+	}
+}
+
+bool MappedFile::map(int descriptor)
+{
+	struct stat st;
+	void *address;
+
+	if (fstat(descriptor, &st) != 0 || !S_ISREG(st.st_mode) || 
+		st.st_size == 0) {
+		return false;
+	}
+	address = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+	if (address == MAP_FAILED) {
+		return false;
+	}
+	// traces are read front to back exactly once
+	madvise(address, st.st_size, MADV_SEQUENTIAL);
+	base = static_cast<char*>(address);
+	length = st.st_size;
+	return true;
+}
+
+TraceReader::TraceReader() : fd(-1), owns_fd(false), pos(NULL), end(NULL), 
+	at_eof(false), line_begin(NULL), line_end(NULL), line_number(0)
+{
+}
+
+TraceReader::~TraceReader()
+{
+	if (owns_fd) {
+		close(fd);
+	}
+}
+
+bool TraceReader::open(const char *filename)
+{
+	int descriptor = ::open(filename, O_RDONLY);
+	if (descriptor < 0) {
+		return false;
+	}
+	attach(descriptor);
+	owns_fd = true;
+	return true;
+}
+
+void TraceReader::attach(int descriptor)
+{
+	fd = descriptor;
+	if (mapping.map(fd)) {
+		pos = mapping.data();
+		end = pos + mapping.size();
+		at_eof = true;
+		return;
+	}
+	// not mappable, read it in chunks
+	buffer.resize(1 << 20);
+	pos = end = buffer.data();
+}
+
+void TraceReader::assign(const char *data, size_t size)
+{
+	pos = data;
+	end = data + size;
+	at_eof = true;
+}
+
+// move the unread tail to the front of the buffer and read more behind it, 
+// false once nothing more can be read
+bool TraceReader::refill()
+{
+	size_t pending = end - pos;
+	ssize_t count;
+
+	if (at_eof) {
+		return false;
+	}
+	memmove(buffer.data(), pos, pending);
+	if (pending == buffer.size()) {
+		// a single line fills the whole buffer
+		buffer.resize(buffer.size() * 2);
+	}
+	do {
+		count = read(fd, buffer.data() + pending, buffer.size() - pending);
+	} while (count < 0 && errno == EINTR);
+	if (count < 0) {
+		throw SimulationError(string("could not read trace: ") + 
+			strerror(errno));
+	}
+	pos = buffer.data();
+	end = pos + pending + count;
+	at_eof = count == 0;
+	return count > 0;
+}
+
+bool TraceReader::nextLine()
+{
+	const char *newline;
+
+	if (pos == end && !refill()) {
+		return false;
+	}
+	while ((newline = static_cast<const char*>(memchr(pos, '\n', 
+	end - pos))) == NULL) {
+		if (!refill()) {
+			// last line has no line break
+			newline = end;
+			break;
+		}
+	}
+	line_begin = pos;
+	line_end = newline;
+	pos = newline == end ? end : newline + 1;
+	++line_number;
+	return true;
+}
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool TraceReader::next(DecodedInstruction &decoded, RegisterTable &registers)
+{
+	while (nextLine()) {
+		const char *p = line_begin;
+		while (p < line_end && isSpace(*p)) {
+			++p;
+		}
+		if (p < line_end) {
+			parse(registers, decoded);
+			return true;
+		}
+		// skip blank lines
+	}
+	return false;
+}
+
+// a length-prefixed name of a binary trace at p, which is moved past it; 
+// throws what on running into end
+static string_view binaryName(const char *&p, const char *end, 
+	const char *what)
+{
+	uint16_t length;
+
+	if (end - p < (long) sizeof(length)) {
+		throw SimulationError(what);
+	}
+	memcpy(&length, p, sizeof(length));
+	p += sizeof(length);
+	if (length == 0 || end - p < length) {
+		throw SimulationError(what);
+	}
+	p += length;
+	return string_view(p - length, length);
+}
+
+bool BinaryTrace::open(const char *filename, RegisterTable &registers)
+{
+	BinaryTraceTrailer trailer;
+	char magic[sizeof(binary_trace_magic)];
+	int descriptor = ::open(filename, O_RDONLY);
+	bool mapped;
+	bool remap = false;
+	const char *p;
+	const char *names_end;
+	const char *opcodes_end;
+	// the current opcode of each one the trace was converted with, or -1
+	vector<int> ops;
+	vector<string> mnemonics;
+
+	if (descriptor < 0) {
+		return false;
+	}
+	// text traces are left to TraceReader
+	if (pread(descriptor, magic, sizeof(magic), 0) != sizeof(magic) || 
+		memcmp(magic, binary_trace_magic, sizeof(magic) - 2) != 0) {
+		close(descriptor);
+		return false;
+	}
+	if (memcmp(magic, binary_trace_magic, sizeof(magic)) != 0) {
+		close(descriptor);
+		throw SimulationError("binary trace of another version, convert it "
+			"again");
+	}
+	mapped = mapping.map(descriptor);
+	close(descriptor);
+	if (!mapped) {
+		throw SimulationError("could not map binary trace");
+	}
+	if (mapping.size() < sizeof(binary_trace_magic) + sizeof(trailer)) {
+		throw SimulationError("truncated binary trace");
+	}
+	opcodes_end = mapping.data() + mapping.size() - sizeof(trailer);
+	memcpy(&trailer, opcodes_end, sizeof(trailer));
+	if (memcmp(trailer.magic, binary_trace_magic, 
+		sizeof(binary_trace_magic)) != 0 || 
+		trailer.count > mapping.size() / sizeof(DecodedInstruction) || 
+		trailer.names_offset != sizeof(binary_trace_magic) + 
+		trailer.count * sizeof(DecodedInstruction) || 
+		trailer.opcodes_offset < trailer.names_offset || 
+		trailer.opcodes_offset > mapping.size() - sizeof(trailer)) {
+		throw SimulationError("truncated binary trace");
+	}
+	// records directly follow the magic number, which keeps them aligned
+	records_ = reinterpret_cast<const DecodedInstruction*>(mapping.data() + 
+		sizeof(binary_trace_magic));
+	count = trailer.count;
+	names_end = mapping.data() + trailer.opcodes_offset;
+	for (p = mapping.data() + trailer.names_offset; p < names_end;) {
+		string_view name = binaryName(p, names_end, 
+			"damaged register names in binary trace");
+		if (registers.intern(name) != registers.size() - 1) {
+			throw SimulationError("damaged register names in binary trace");
+		}
+	}
+	// the opcode table may have changed since, through --opcodes; records 
+	// are remapped by mnemonic, as long as each keeps its format
+	for (p = names_end; p < opcodes_end;) {
+		int format = (unsigned char)*p++;
+		string_view mnemonic = binaryName(p, opcodes_end, 
+			"damaged opcodes in binary trace");
+		int op = findOpcode(mnemonic);
+
+		if (op >= 0 && opcodes[op].format != format) {
+			op = -1;
+		}
+		remap = remap || op != (int)ops.size();
+		ops.push_back(op);
+		mnemonics.push_back(string(mnemonic));
+	}
+	// check once here so the simulator can trust every record
+	for (size_t i = 0; i < count; ++i) {
+		const DecodedInstruction &r = records_[i];
+		if (r.opcode >= ops.size() || 
+			(r.destination_register != NO_REG && 
+			r.destination_register >= registers.size()) || 
+			(r.source_register1 != NO_REG && 
+			r.source_register1 >= registers.size()) || 
+			(r.source_register2 != NO_REG && 
+			r.source_register2 >= registers.size())) {
+			char message[64];
+			snprintf(message, sizeof(message), 
+				"invalid record %zu in binary trace", i + 1);
+			throw SimulationError(message);
+		}
+		if (ops[r.opcode] < 0) {
+			throw SimulationError("binary trace was converted with " + 
+				mnemonics[r.opcode] + " in another opcode table, convert "
+				"it again");
+		}
+	}
+	if (remap) {
+		// the mapping cannot be written to, so the records are copied
+		remapped.assign(records_, records_ + count);
+		for (size_t i = 0; i < count; ++i) {
+			remapped[i].opcode = ops[remapped[i].opcode];
+		}
+		records_ = remapped.data();
+	}
+	return true;
+}
+
+void TraceReader::fail(const char *at, const char *message) const
+{
+	char text[128];
+	snprintf(text, sizeof(text), "line %zu, column %zu: %s", line_number, 
+		static_cast<size_t>(at - line_begin) + 1, message);
+	throw SimulationError(text);
+}
+
+// decode the current line in place; operands are separated by the same 
+// delimiters the trace format always used, surrounding whitespace is ignored
+void TraceReader::parse(RegisterTable &registers, DecodedInstruction &decoded)
+{
+	const char *p = line_begin;
+	const char *const eol = line_end;
+	string_view destination_register;
+	string_view source_register1;
+	string_view source_register2;
+	int op;
+
+	// operand up to a delimiter, which is consumed
+	auto field = [&](char delimiter, const char *message) {
+		const char *first, *last;
+		while (p < eol && isSpace(*p)) {
+			++p;
+		}
+		first = p;
+		while (p < eol && *p != delimiter) {
+			++p;
+		}
+		if (p == eol) {
+			fail(p, message);
+		}
+		last = p++;
+		while (last > first && isSpace(last[-1])) {
+			--last;
+		}
+		return string_view(first, last - first);
+	};
+	// operand up to the next whitespace
+	auto token = [&](const char *message) {
+		const char *first;
+		while (p < eol && isSpace(*p)) {
+			++p;
+		}
+		first = p;
+		while (p < eol && !isSpace(*p)) {
+			++p;
+		}
+		if (p == first) {
+			fail(p, message);
+		}
+		return string_view(first, p - first);
+	};
+	// register operand, which may not be empty
+	auto reg = [&](string_view name) {
+		if (name.empty()) {
+			fail(name.data(), "missing register");
+		}
+		return name;
+	};
+	// displacement and opening parenthesis of a memory operand
+	auto displacement = [&]() {
+		const char *start;
+		while (p < eol && isSpace(*p)) {
+			++p;
+		}
+		if (p < eol && (*p == '-' || *p == '+')) {
+			++p;
+		}
+		start = p;
+		while (p < eol && *p >= '0' && *p <= '9') {
+			++p;
+		}
+		if (p == start) {
+			fail(p, "expected displacement");
+		}
+		while (p < eol && isSpace(*p)) {
+			++p;
+		}
+		if (p == eol || *p != '(') {
+			fail(p, "expected '(' after displacement");
+		}
+		++p;
+	};
+
+	// read instruction type
+	string_view mnemonic = token("missing instruction");
+	if ((op = findOpcode(mnemonic)) < 0) {
+		fail(mnemonic.data(), "invalid instruction");
+	}
+	decoded.opcode = op;
+	decoded.flags = 0;
+	switch (opcodes[op].format) {
+	case FORMAT_LOAD:
+		// if instruction is a load, need destination register and 
+		// displacement (in that order)
+		destination_register = reg(field(',', "expected ','"));
+		displacement();
+		source_register1 = reg(field(')', "expected ')'"));
+		break;
+	case FORMAT_STORE:
+		// if instruction is a store, need source register, displacement, and
+		// destination register (in that order)
+		source_register1 = reg(field(',', "expected ','"));
+		displacement();
+		destination_register = reg(field(')', "expected ')'"));
+		break;
+	case FORMAT_BRANCH:
+		// if instruction is a branch, need source registers, the label to
+		// jump to, and whether or not the branch is taken (in that order)
+		source_register1 = reg(field(',', "expected ','"));
+		source_register2 = reg(field(',', "expected ','"));
+		field(':', "expected ':' after label");
+		if (token("expected branch outcome")[0] == 'T') {
+			decoded.flags |= FLAG_TAKEN;
+		}
+		break;
+	case FORMAT_MOVE:
+		// if instruction is data movement (from) or data conversion, need
+		// destination register and source register (in that order)
+		destination_register = reg(field(',', "expected ','"));
+		source_register1 = token("missing register");
+		break;
+	case FORMAT_MOVE_TO:
+		// if instruction is data movement (to), need source register and
+		// destination register (in that order)
+		source_register1 = reg(field(',', "expected ','"));
+		destination_register = token("missing register");
+		break;
+	default:
+		// r-type instructions, need destination register and source registers
+		// (in that order)
+		destination_register = reg(field(',', "expected ','"));
+		source_register1 = reg(field(',', "expected ','"));
+		source_register2 = token("missing register");
+	}
+	while (p < eol && isSpace(*p)) {
+		++p;
+	}
+	if (p < eol) {
+		fail(p, "unexpected text after instruction");
+	}
+	if (!destination_register.empty() && destination_register[0] == 'F') {
+		decoded.flags |= FLAG_FP_DEST;
+	}
+	decoded.destination_register = registers.intern(destination_register);
+	decoded.source_register1 = registers.intern(source_register1);
+	decoded.source_register2 = registers.intern(source_register2);
+}
+
+// yields before an end of the ring sleeps; a parser or simulator that is 
+// only briefly behind is caught up with before then
+const int PREFETCH_SPINS = 64;
+
+PrefetchSource::PrefetchSource(TraceReader &reader, RegisterTable &registers)
+	: done(false), stop(false), producer_asleep(false), 
+	consumer_asleep(false), popped(0)
+{
+	producer = thread(&PrefetchSource::produce, this, ref(reader), 
+		ref(registers));
+	// an error on the first line surfaces here, as with StreamSource
+	try {
+		wait();
+	} catch (...) {
+		producer.join();
+		throw;
+	}
+}
+
+PrefetchSource::~PrefetchSource()
+{
+	stop = true;
+	wake(producer_asleep);
+	producer.join();
+}
+
+template <typename Ready> 
+void PrefetchSource::sleep(atomic<bool> &asleep, Ready ready)
+{
+	unique_lock<mutex> lock(sleep_lock);
+
+	asleep = true;
+	// pairs with the fence in wake: either the other end sees asleep, or 
+	// ready sees what the other end did before it looked
+	atomic_thread_fence(memory_order_seq_cst);
+	while (!ready()) {
+		woken.wait(lock);
+	}
+	asleep.store(false, memory_order_relaxed);
+}
+
+void PrefetchSource::wake(atomic<bool> &asleep)
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if (asleep.load(memory_order_relaxed)) {
+		lock_guard<mutex> lock(sleep_lock);
+		woken.notify_one();
+	}
+}
+
+void PrefetchSource::produce(TraceReader &reader, RegisterTable &registers)
+{
+	DecodedInstruction decoded;
+
+	try {
+		while (reader.next(decoded, registers)) {
+			for (int spins = 0; !ring.push(decoded); ++spins) {
+				if (stop) {
+					return;
+				}
+				if (spins < PREFETCH_SPINS) {
+					// the simulator is behind, let it catch up
+					this_thread::yield();
+				} else {
+					sleep(producer_asleep, [this]() { 
+						return stop || !ring.full(); 
+					});
+				}
+			}
+			wake(consumer_asleep);
+		}
+	} catch (const SimulationError &e) {
+		error = e.what();
+	}
+	done.store(true, memory_order_release);
+	wake(consumer_asleep);
+}
+
+// wait until an instruction is available, false at the end of the trace
+bool PrefetchSource::wait()
+{
+	for (int spins = 0; ring.empty(); ++spins) {
+		if (done.load(memory_order_acquire)) {
+			// the producer pushes everything before it sets done
+			if (!ring.empty()) {
+				break;
+			}
+			if (!error.empty()) {
+				throw SimulationError(error);
+			}
+			return false;
+		}
+		// the parser is behind, which only happens while a trace is still 
+		// being written to a pipe
+		if (spins < PREFETCH_SPINS) {
+			this_thread::yield();
+		} else {
+			sleep(consumer_asleep, [this]() { 
+				return done.load(memory_order_acquire) || !ring.empty(); 
+			});
+		}
+	}
+	return true;
+}
+
+bool PrefetchSource::next(DecodedInstruction &instruction)
+{
+	if (!wait()) {
+		return false;
+	}
+	ring.pop(instruction);
+	// a producer asleep on a full ring is woken within a quarter of it, 
+	// which keeps the fence off most instructions
+	if (++popped % (InstructionRing::CAPACITY / 4) == 0) {
+		wake(producer_asleep);
+	}
+	// an error right after this instruction surfaces now, as with 
+	// StreamSource
+	wait();
+	return true;
+}
+
+void getInstructions(vector<DecodedInstruction> &instructions, 
+	RegisterTable &registers, TraceReader &in, bool echo, size_t limit)
+{
+	DecodedInstruction decoded;
+	size_t i = 1;
+
+	// read in and print instructions
+	if (echo) {
+		printf("Instructions:\n");
+	}
+	while (in.next(decoded, registers)) {
+		if (limit && i > limit) {
+			throw SimulationError("too many instructions in the trace");
+		}
+		instructions.push_back(decoded);
+		// print out instruction
+		if (echo) {
+			printf("%3zu. %.*s\n", i, (int) in.line().size(), 
+				in.line().data());
+		}
+		++i;
+	}
+	if (echo) {
+		printf("\n\n");
+	}
+}
+
+void convertTrace(TraceReader &in, RegisterTable &registers, 
+	const char *filename)
+{
+	BufferedWriter out(filename);
+	DecodedInstruction decoded;
+	BinaryTraceTrailer trailer;
+
+	out.write(binary_trace_magic, sizeof(binary_trace_magic));
+	trailer.count = 0;
+	while (in.next(decoded, registers)) {
+		out.write(&decoded, sizeof(decoded));
+		++trailer.count;
+	}
+	trailer.names_offset = sizeof(binary_trace_magic) + 
+		trailer.count * sizeof(decoded);
+	for (size_t reg = 0; reg < registers.size(); ++reg) {
+		const string &name = registers.name(reg);
+		uint16_t length = name.size();
+		if (name.size() > UINT16_MAX) {
+			throw SimulationError("register name too long for binary trace");
+		}
+		out.write(&length, sizeof(length));
+		out.write(name.data(), length);
+	}
+	trailer.opcodes_offset = trailer.names_offset;
+	for (size_t reg = 0; reg < registers.size(); ++reg) {
+		trailer.opcodes_offset += sizeof(uint16_t) + 
+			registers.name(reg).size();
+	}
+	for (int op = 0; op < opcode_count; ++op) {
+		uint8_t format = opcodes[op].format;
+		uint16_t length = opcodes[op].name.size();
+		out.write(&format, sizeof(format));
+		out.write(&length, sizeof(length));
+		out.write(opcodes[op].name.data(), length);
+	}
+	memcpy(trailer.magic, binary_trace_magic, sizeof(binary_trace_magic));
+	out.write(&trailer, sizeof(trailer));
+	out.close();
+}
@@ -0,0 +1,216 @@
+// reading traces: text traces parsed in place and mapped binary traces
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "simulator.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// read-only mapping of a whole regular file
+class MappedFile {
+public:
+	MappedFile() : base(NULL), length(0) {}
+	~MappedFile();
+	// map the file open on descriptor, false if it is not a non-empty 
+	// regular file or cannot be mapped
+	bool map(int descriptor);
+	const char *data() const { return base; }
+	size_t size() const { return length; }
+private:
+	char *base;
+	size_t length;
+};
+
+// hands out the lines of a trace without copying them; regular files are 
+// memory-mapped, anything else (stdin, pipes) is read in large chunks, and 
+// a trace already in memory is read in place
+class TraceReader {
+public:
+	TraceReader();
+	~TraceReader();
+	// open a trace file, false if it cannot be opened
+	bool open(const char *filename);
+	// read the trace from an already open descriptor, such as stdin
+	void attach(int descriptor);
+	// read the trace from memory, which has to outlive the reader
+	void assign(const char *data, size_t size);
+	// decode the next non-blank line, false at the end of the trace
+	bool next(DecodedInstruction &decoded, RegisterTable &registers);
+	// text and number of the line last decoded by next
+	std::string_view line() const { return std::string_view(line_begin, 
+		line_end - line_begin); }
+	size_t lineNumber() const { return line_number; }
+private:
+	bool nextLine();
+	bool refill();
+	void parse(RegisterTable &registers, DecodedInstruction &decoded);
+	[[noreturn]] void fail(const char *at, const char *message) const;
+	int fd;
+	bool owns_fd;
+	// used unless the file is mapped
+	MappedFile mapping;
+	std::vector<char> buffer;
+	// unread part of the mapping or buffer
+	const char *pos;
+	const char *end;
+	bool at_eof;
+	const char *line_begin;
+	const char *line_end;
+	size_t line_number;
+};
+
+// binary trace mapped into memory, the simulator reads its records in place 
+// unless their opcodes have to be renumbered
+class BinaryTrace {
+public:
+	// false if the file cannot be opened or is not a binary trace, throws 
+	// if it is one but is damaged
+	bool open(const char *filename, RegisterTable &registers);
+	const DecodedInstruction *records() const { return records_; }
+	size_t size() const { return count; }
+private:
+	MappedFile mapping;
+	// a copy of the records with their opcodes renumbered, if the opcode 
+	// table is not the one the trace was converted with
+	std::vector<DecodedInstruction> remapped;
+	const DecodedInstruction *records_;
+	size_t count;
+};
+
+// parses instructions on demand from a stream, only one instruction is held
+// ahead of the IF stage so memory does not grow with trace length
+class StreamSource : public InstructionSource {
+public:
+	StreamSource(TraceReader &reader, RegisterTable &regs) 
+		: in(reader), registers(regs), have_lookahead(false) 
+	{
+		fill();
+	}
+	bool next(DecodedInstruction &instruction)
+	{
+		if (!have_lookahead) {
+			return false;
+		}
+		instruction = lookahead;
+		fill();
+		return true;
+	}
+	bool empty() { return !have_lookahead; }
+private:
+	// parse the next non-blank line into the lookahead slot
+	void fill()
+	{
+		have_lookahead = in.next(lookahead, registers);
+	}
+	TraceReader &in;
+	RegisterTable &registers;
+	DecodedInstruction lookahead;
+	bool have_lookahead;
+};
+
+// single-producer/single-consumer ring of decoded instructions that needs 
+// no locks: only the producer moves tail and only the consumer moves head
+class InstructionRing {
+public:
+	InstructionRing() : head(0), cached_tail(0), tail(0), cached_head(0) {}
+	// false if the ring is full
+	bool push(const DecodedInstruction &instruction)
+	{
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - cached_head == CAPACITY) {
+			cached_head = head.load(std::memory_order_acquire);
+			if (t - cached_head == CAPACITY) {
+				return false;
+			}
+		}
+		slots[t & (CAPACITY - 1)] = instruction;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	// false if the ring is empty
+	bool pop(DecodedInstruction &instruction)
+	{
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == cached_tail) {
+			cached_tail = tail.load(std::memory_order_acquire);
+			if (h == cached_tail) {
+				return false;
+			}
+		}
+		instruction = slots[h & (CAPACITY - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	bool empty() const
+	{
+		return head.load(std::memory_order_relaxed) == 
+			tail.load(std::memory_order_acquire);
+	}
+	// for the producer
+	bool full() const
+	{
+		return tail.load(std::memory_order_relaxed) - 
+			head.load(std::memory_order_acquire) == CAPACITY;
+	}
+	static const size_t CAPACITY = 4096;
+private:
+	DecodedInstruction slots[CAPACITY];
+	// each end on a cache line of its own, next to the copy of the other 
+	// end that its thread last saw
+	alignas(64) std::atomic<size_t> head;
+	size_t cached_tail;
+	alignas(64) std::atomic<size_t> tail;
+	size_t cached_head;
+};
+
+// parses a stream on a thread of its own while the simulator runs, handing 
+// instructions over through an InstructionRing; like StreamSource, memory 
+// does not grow with trace length, and a parse error is thrown by the next 
+// call that would have needed the bad line
+class PrefetchSource : public InstructionSource {
+public:
+	PrefetchSource(TraceReader &reader, RegisterTable &registers);
+	~PrefetchSource();
+	bool next(DecodedInstruction &instruction);
+	bool empty() { return !wait(); }
+private:
+	void produce(TraceReader &reader, RegisterTable &registers);
+	bool wait();
+	// an end that has spun for a while sleeps until ready(), with asleep set 
+	// so that the other end wakes it
+	template <typename Ready> void sleep(std::atomic<bool> &asleep, 
+		Ready ready);
+	void wake(std::atomic<bool> &asleep);
+	InstructionRing ring;
+	// set by the producer once it has pushed its last instruction
+	std::atomic<bool> done;
+	// set by the consumer when it goes away before the end of the trace
+	std::atomic<bool> stop;
+	// parse error met by the producer, valid once done is set
+	std::string error;
+	// the producer sleeps only on a full ring and the consumer only on an 
+	// empty one, so each is woken when that changes
+	std::atomic<bool> producer_asleep;
+	std::atomic<bool> consumer_asleep;
+	std::mutex sleep_lock;
+	std::condition_variable woken;
+	// instructions taken by the consumer
+	size_t popped;
+	std::thread producer;
+};
+
+// decode a whole trace, printing its lines if echo is set; a limit of 0 
+// reads the whole trace, otherwise longer traces are an error
+void getInstructions(std::vector<DecodedInstruction>&, RegisterTable&, 
+	TraceReader&, bool echo, size_t limit);
+// write a text trace as a binary trace
+void convertTrace(TraceReader&, RegisterTable&, const char *filename);
+
+#endif
@@ -0,0 +1,100 @@
+# runs a generated trace in every way that has to give the same results as
+# the plain run: fast-forwarded, with loop extrapolation, from a binary trace
+# and restored from checkpoints; the statistics of each run, and its
+# timeline where it writes one, are compared with the plain run's
+#
+#   cmake -DPIPE=pipe -DTRACEGEN=tracegen -DDIR=dir -DSEED=n [-DMIX=spec]
+#         [-DUNITS="fmul_units: 2,fadd_pipelined: 1"] [-DREADS=1]
+#         -P regression.cmake
+#
+# with READS the trace ends with a MOV.S reading an ADD.S and a MUL.S result
+# from every distance up to seven instructions, so that one is decoded in
+# the cycle its producer completes
+#
+# MIX is passed to tracegen; with FP patterns close together, results
+# finishing in the same cycle stall the original single units for good, so
+# dense mixes go with UNITS that let results wait for FWB
+
+file(REMOVE_RECURSE ${DIR})
+file(MAKE_DIRECTORY ${DIR})
+string(REPLACE "," "\n" units "${UNITS}")
+file(WRITE ${DIR}/config.txt "fp_add_sub: 2\nfp_mul: 5\nfp_div: 10\n${units}\n")
+
+# run a program in DIR, its output to name.out; a run that deadlocks
+# without -f never ends, so it fails after a minute
+function(run name)
+	execute_process(COMMAND ${ARGN} WORKING_DIRECTORY ${DIR}
+		OUTPUT_FILE ${DIR}/${name}.out RESULT_VARIABLE result TIMEOUT 60)
+	if(NOT result EQUAL 0)
+		list(JOIN ARGN " " command)
+		message(FATAL_ERROR "${name}: ${command} failed: ${result}")
+	endif()
+endfunction()
+
+# fail unless two files in DIR are the same
+function(same expected actual)
+	execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+		${DIR}/${expected} ${DIR}/${actual} RESULT_VARIABLE result)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${actual} differs from ${expected}")
+	endif()
+endfunction()
+
+if(MIX)
+	set(mix -m ${MIX})
+endif()
+run(tracegen ${TRACEGEN} -n 3000 -s ${SEED} ${mix} trace.txt)
+if(READS)
+	foreach(op ADD.S MUL.S)
+		foreach(gap RANGE 7)
+			file(APPEND ${DIR}/trace.txt "${op} F1,F16,F17\n")
+			foreach(i RANGE 1 ${gap})
+				if(gap GREATER 0)
+					file(APPEND ${DIR}/trace.txt "DADD R1,R2,R3\n")
+				endif()
+			endforeach()
+			file(APPEND ${DIR}/trace.txt "MOV.S F2,F1\nDADD R4,R5,R6\n")
+		endforeach()
+	endforeach()
+endif()
+run(plain ${PIPE} -s -q --timeline-csv plain.csv trace.txt)
+
+run(fast ${PIPE} -s -q -f --timeline-csv fast.csv trace.txt)
+same(plain.out fast.out)
+same(plain.csv fast.csv)
+
+run(convert ${PIPE} --convert trace.bin trace.txt)
+run(binary ${PIPE} -s -q --timeline-csv binary.csv trace.bin)
+same(plain.out binary.out)
+same(plain.csv binary.csv)
+
+# loops are only extrapolated without a timeline, over a trace held in
+# memory or a window of a stream
+run(loops ${PIPE} -q -l trace.bin)
+same(plain.out loops.out)
+run(loops-stream ${PIPE} -s -q -l trace.txt)
+same(plain.out loops-stream.out)
+
+# a restored run writes the rows of the cycles after its checkpoint
+file(STRINGS ${DIR}/plain.csv rows)
+list(LENGTH rows count)
+math(EXPR first "(${count} - 1) / 3")
+math(EXPR second "(${count} - 1) * 2 / 3")
+run(checkpoint ${PIPE} -s -q --checkpoint check.bin
+	--checkpoint-at ${first},${second} trace.txt)
+same(plain.out checkpoint.out)
+set(point 1)
+foreach(cycle ${first} ${second})
+	run(restore-${point} ${PIPE} -s -q --restore check.bin.${point}
+		--timeline-csv restore-${point}.csv trace.txt)
+	same(plain.out restore-${point}.out)
+	math(EXPR after "${cycle} + 1")
+	list(GET rows 0 header)
+	list(SUBLIST rows ${after} -1 expected)
+	file(STRINGS ${DIR}/restore-${point}.csv restored)
+	if(NOT "${header};${expected}" STREQUAL "${restored}")
+		message(FATAL_ERROR "restore-${point}.csv differs from plain.csv "
+			"after cycle ${cycle}")
+	endif()
+	math(EXPR point "${point} + 1")
+endforeach()